@@ -1,7 +1,100 @@
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "game_state_controller.hpp"
 
 // Main
+// Usage: earth [--record FILE] [--replay FILE] [--magnitudes MX:MY,...] [--accelerogram FILE [--gain X]] [--adaptive] [--world WxH] [--profile-csv FILE] [--trace FILE]
 int main(int argc, char** argv) {
-    game::GameStateController game_state_controller;
+    std::string record_path;
+    std::string replay_path;
+    std::string profile_csv_path;
+    std::string trace_path;
+    std::string magnitudes;
+    std::string accelerogram_path;
+    double gain = 1;
+    bool adaptive = false;
+    unsigned int world_width = WIDTH;
+    unsigned int world_height = HEIGHT;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--record" && i + 1 < argc) {
+            record_path = argv[++i];
+        }
+        else if (arg == "--replay" && i + 1 < argc) {
+            replay_path = argv[++i];
+        }
+        else if (arg == "--magnitudes" && i + 1 < argc) {
+            magnitudes = argv[++i];
+        }
+        else if (arg == "--accelerogram" && i + 1 < argc) {
+            accelerogram_path = argv[++i];
+        }
+        else if (arg == "--gain" && i + 1 < argc) {
+            gain = std::atof(argv[++i]);
+        }
+        else if (arg == "--adaptive") {
+            adaptive = true;
+        }
+        else if (arg == "--world" && i + 1 < argc) {
+            // The world may be larger than the window, it is then scrolled through
+            std::string size = argv[++i];
+            std::size_t x = size.find('x');
+            world_width = x == std::string::npos ? 0 : std::atoi(size.substr(0, x).c_str());
+            world_height = x == std::string::npos ? 0 : std::atoi(size.substr(x + 1).c_str());
+            if (world_width == 0 || world_height <= INIT_GROUND_LEVEL) {
+                std::cerr << "Invalid world size " << size << "\n";
+                return 1;
+            }
+        }
+        else if (arg == "--profile-csv" && i + 1 < argc) {
+            profile_csv_path = argv[++i];
+        }
+        else if (arg == "--trace" && i + 1 < argc) {
+            trace_path = argv[++i];
+        }
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--record FILE] [--replay FILE] [--magnitudes MX:MY,...] [--accelerogram FILE [--gain X]] [--adaptive] [--world WxH] [--profile-csv FILE] [--trace FILE]\n";
+            return 1;
+        }
+    }
+
+    // The ground motion of a record is not part of the event log
+    if (!accelerogram_path.empty() && (!record_path.empty() || !replay_path.empty())) {
+        std::cerr << "An accelerogram can not be used while recording or replaying\n";
+        return 1;
+    }
+    // Events are logged by step, which an adaptive timestep would not reproduce
+    if (adaptive && (!record_path.empty() || !replay_path.empty())) {
+        std::cerr << "An adaptive timestep can not be used while recording or replaying\n";
+        return 1;
+    }
+
+    try {
+        if (!profile_csv_path.empty()) {
+            profiling::Profiler::instance().open_csv(profile_csv_path);
+        }
+        if (!trace_path.empty()) {
+            profiling::Profiler::instance().open_trace(trace_path);
+        }
+        std::vector<game::magnitudes_t> parsed;
+        if (!magnitudes.empty()) {
+            parsed = game::parse_magnitudes(magnitudes);
+        }
+        game::GameStateController game_state_controller(record_path, replay_path, parsed, world_width, world_height);
+        if (!accelerogram_path.empty()) {
+            for (std::size_t i = 0; i < game_state_controller.simulations.size(); ++i) {
+                game_state_controller.simulations[i].set_ground_motion(std::make_unique<game::AccelerogramMotion>(game::open_accelerogram(accelerogram_path), gain));
+            }
+        }
+        game_state_controller.adaptive_timestep = adaptive;
+        game_state_controller.run();
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
     return 0;
-}
\ No newline at end of file
+}
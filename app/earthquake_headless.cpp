@@ -0,0 +1,599 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "earthquake_system.hpp"
+#include "frame_exporter.hpp"
+#include "simulation_pool.hpp"
+#include "snapshot.hpp"
+#include "software_renderer.hpp"
+#include "strain_metrics.hpp"
+#include "structure_builder.hpp"
+#include "event_log.hpp"
+
+namespace {
+    // Default world dimensions, the same as the windowed program's
+    constexpr unsigned int DEFAULT_WIDTH = 640;
+    constexpr unsigned int DEFAULT_HEIGHT = 480;
+    constexpr unsigned int DEFAULT_GROUND_LEVEL = 40;
+
+    // Spacing of the build grid, the same as the windowed program's
+    constexpr float GRID = game::EarthquakeSystem<float>::GRID_SIZE;
+
+    // Physics steps per second of the windowed program, at which videos play in real time
+    constexpr unsigned int PHYSICS_RATE = 60;
+
+    struct options_t {
+        unsigned long steps = 1000;
+        unsigned int magnitude_x = 1;
+        unsigned int magnitude_y = 1;
+        unsigned int width = DEFAULT_WIDTH;
+        unsigned int height = DEFAULT_HEIGHT;
+        std::string structure = "frame";
+        unsigned int floors = 8;
+        unsigned int bays = 3;
+        unsigned int threads = 1;
+        unsigned int jobs = 0;
+        unsigned int frame_every = 2;
+        unsigned int runs = 1;
+        std::vector<game::magnitudes_t> magnitudes;
+        physics::SolverConfig<float> solver;
+        float gain = 1;
+        float sleep_threshold = game::EarthquakeSystem<float>::SLEEP_THRESHOLD;
+        float collision_radius = game::EarthquakeSystem<float>::COLLISION_RADIUS;
+        physics::StrainConfig<float> strain;
+        bool print_positions = true;
+        bool adaptive = false;
+        game::TimestepConfig timestep;
+        std::string load_path;
+        std::string save_path;
+        std::string record_path;
+        std::string replay_path;
+        std::string profile_csv_path;
+        std::string trace_path;
+        std::string accelerogram_path;
+        std::string video_path;
+        std::string strain_log_path;
+    };
+
+    void usage(const char* program) {
+        std::cerr << "Usage: " << program << " [options]\n"
+                  << "  --steps N          number of simulation steps to run, 0 runs until the accelerogram ends (default 1000)\n"
+                  << "  --magnitude-x N    horizontal magnitude of the earthquake, 0-9 (default 1)\n"
+                  << "  --magnitude-y N    vertical magnitude of the earthquake, 0-9 (default 1)\n"
+                  << "  --accelerogram FILE drive the ground with the ground acceleration recorded in the CSV or binary\n"
+                  << "                     FILE instead of the magnitudes, from the start of the record\n"
+                  << "  --gain X           scale of the recorded accelerations, 1 plays a record in g to scale (default 1)\n"
+                  << "  --width N          width of the world (default 640)\n"
+                  << "  --height N         height of the world (default 480)\n"
+                  << "  --structure NAME   generated structure: frame (a cross braced building), truss or grid (default frame)\n"
+                  << "  --floors N         number of floors of the generated frame or rows of the grid (default 8)\n"
+                  << "  --bays N           number of bays of the generated frame, panels of the truss or columns of the\n"
+                  << "                     grid (default 3)\n"
+                  << "  --magnitudes LIST  run one simulation per horizontal:vertical magnitudes in the comma\n"
+                  << "                     separated LIST (eg: 1:1,3:2) concurrently, instead of a single one\n"
+                  << "  --jobs N           number of simulations run at once (default: all of them, at most one per core)\n"
+                  << "  --runs N           build and run the structure N times in every simulation, clearing it in between\n"
+                  << "                     and reusing its memory (default 1)\n"
+                  << "  --adaptive         choose every timestep from the speed of the ground and of the particles, the\n"
+                  << "                     run then lasts as long as --steps steps of the default timestep\n"
+                  << "  --max-distance X   farthest the ground or a particle may move in an adaptive step (default 4)\n"
+                  << "  --threads N        number of threads used to relax joints (default 1)\n"
+                  << "  --tolerance X      stop relaxing once joint errors are at most X (default 0)\n"
+                  << "  --min-iterations N minimum relaxation iterations per step (default 1)\n"
+                  << "  --max-iterations N maximum relaxation iterations per step (default 10)\n"
+                  << "  --sleep-threshold X energy below which still structures fall asleep, 0 never sleeps (default 0.0001)\n"
+                  << "  --collision-radius X radius of the particles when they collide, 0 disables collisions (default 4)\n"
+                  << "  --load FILE        start from the snapshot in FILE instead of building a structure\n"
+                  << "  --save FILE        write a snapshot of the final state to FILE\n"
+                  << "  --record FILE      record the run to the event log FILE\n"
+                  << "  --replay FILE      replay the session recorded in the event log FILE, in its world, with its\n"
+                  << "                     solver, sleep and collision settings and for as many steps as it lasted,\n"
+                  << "                     instead of building a structure\n"
+                  << "  --video FILE       draw the run into FILE, a YUV4MPEG2 video if it ends in .y4m or else a PNG\n"
+                  << "                     image per frame numbered after FILE\n"
+                  << "  --frame-every N    draw a frame every N steps, the video playing at 60 / N frames per second (default 2)\n"
+                  << "  --strain-log FILE  write the largest and rms joint strains, the number of damaged joints and a\n"
+                  << "                     histogram of the strains of every step to the CSV file FILE\n"
+                  << "  --damage-threshold X strain beyond which a joint counts as damaged (default 0.1)\n"
+                  << "  --profile-csv FILE write the time spent in each phase of every step to the CSV file FILE\n"
+                  << "  --trace FILE       write every timed phase to the Chrome trace event file FILE\n"
+                  << "  --no-positions     do not print the final particle positions\n";
+    }
+
+    // Parses the command line. Returns false if it is invalid.
+    bool parse_options(int argc, char** argv, options_t& options) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--no-positions") {
+                options.print_positions = false;
+                continue;
+            }
+            if (arg == "--adaptive") {
+                options.adaptive = true;
+                continue;
+            }
+            if (i + 1 >= argc) {
+                return false;
+            }
+            if (arg == "--load")    { options.load_path = argv[++i]; continue; }
+            if (arg == "--structure") { options.structure = argv[++i]; continue; }
+            if (arg == "--save")    { options.save_path = argv[++i]; continue; }
+            if (arg == "--record")  { options.record_path = argv[++i]; continue; }
+            if (arg == "--replay")  { options.replay_path = argv[++i]; continue; }
+            if (arg == "--profile-csv") { options.profile_csv_path = argv[++i]; continue; }
+            if (arg == "--trace")   { options.trace_path = argv[++i]; continue; }
+            if (arg == "--video")   { options.video_path = argv[++i]; continue; }
+            if (arg == "--strain-log") { options.strain_log_path = argv[++i]; continue; }
+            if (arg == "--magnitudes") {
+                try {
+                    options.magnitudes = game::parse_magnitudes(argv[++i]);
+                } catch (std::invalid_argument& e) {
+                    std::cerr << e.what() << std::endl;
+                    return false;
+                }
+                continue;
+            }
+            if (arg == "--accelerogram") { options.accelerogram_path = argv[++i]; continue; }
+            if (arg == "--tolerance" || arg == "--sleep-threshold" || arg == "--gain" || arg == "--collision-radius"
+                    || arg == "--damage-threshold" || arg == "--max-distance") {
+                char* end = nullptr;
+                float value = std::strtof(argv[++i], &end);
+                if (*end != '\0') {
+                    return false;
+                }
+                if (arg == "--tolerance")           options.solver.tolerance = value;
+                else if (arg == "--sleep-threshold") options.sleep_threshold = value;
+                else if (arg == "--collision-radius") options.collision_radius = value;
+                else if (arg == "--damage-threshold") options.strain.damage_threshold = value;
+                else if (arg == "--max-distance") options.timestep.max_distance = value;
+                else                                options.gain = value;
+                continue;
+            }
+
+            char* end = nullptr;
+            unsigned long value = std::strtoul(argv[++i], &end, 10);
+            if (*end != '\0') {
+                return false;
+            }
+
+            if (arg == "--steps")               options.steps = value;
+            else if (arg == "--magnitude-x")    options.magnitude_x = value;
+            else if (arg == "--magnitude-y")    options.magnitude_y = value;
+            else if (arg == "--width")          options.width = value;
+            else if (arg == "--height")         options.height = value;
+            else if (arg == "--floors")         options.floors = value;
+            else if (arg == "--bays")           options.bays = value;
+            else if (arg == "--threads")        options.threads = value;
+            else if (arg == "--jobs")           options.jobs = value;
+            else if (arg == "--frame-every")    options.frame_every = value;
+            else if (arg == "--runs")           options.runs = value;
+            else if (arg == "--min-iterations") options.solver.min_iterations = value;
+            else if (arg == "--max-iterations") options.solver.max_iterations = value;
+            else                                return false;
+        }
+        // a recording must start from a world that can be rebuilt from the log alone
+        if (!options.record_path.empty() && (!options.load_path.empty() || !options.replay_path.empty())) {
+            return false;
+        }
+        // the ground motion of a record can neither be logged nor varied per simulation, and a snapshot
+        // does not hold how far into the record it was taken
+        if (!options.accelerogram_path.empty() && (!options.record_path.empty() || !options.replay_path.empty() || !options.magnitudes.empty()
+                || !options.load_path.empty())) {
+            return false;
+        }
+        // simulations run side by side have no single session or final state to write
+        if (!options.magnitudes.empty() && (!options.record_path.empty() || !options.replay_path.empty() || !options.save_path.empty())) {
+            return false;
+        }
+        // simulations run side by side have no single picture to draw or strain to log
+        if ((!options.video_path.empty() || !options.strain_log_path.empty()) && !options.magnitudes.empty()) {
+            return false;
+        }
+        // repeated runs are run like side by side simulations
+        if (options.runs > 1 && (!options.record_path.empty() || !options.replay_path.empty() || !options.save_path.empty()
+                || !options.video_path.empty() || !options.strain_log_path.empty() || !options.accelerogram_path.empty() || options.adaptive)) {
+            return false;
+        }
+        // events are logged by step, which an adaptive timestep would not reproduce
+        if (options.adaptive && (!options.record_path.empty() || !options.replay_path.empty() || !options.magnitudes.empty())) {
+            return false;
+        }
+        if (options.collision_radius < 0 || options.frame_every == 0 || options.runs == 0 || !(options.timestep.max_distance > 0)) {
+            return false;
+        }
+        if (options.structure != "frame" && options.structure != "truss" && options.structure != "grid") {
+            return false;
+        }
+        using System = game::EarthquakeSystem<float>;
+        return options.magnitude_x <= System::MAGNITUDE_UPPER_BOUND && options.magnitude_y <= System::MAGNITUDE_UPPER_BOUND;
+    }
+
+    // Builds the structure chosen by the options centered in the world standing on the ground. The
+    // joints are recorded to recorder if it is not null.
+    void build_structure(game::EarthquakeSystem<float>& system, const options_t& options, game::EventRecorder* recorder) {
+        game::StructureBuilder<float> builder;
+        unsigned int width = options.structure == "grid" ? options.bays - 1 : options.bays;
+        float x0 = static_cast<int>((options.width - width * GRID) / 2 / GRID) * GRID;
+        float y0 = system.ground_height();
+        if (options.structure == "truss") {
+            game::add_truss(builder, x0, y0, options.bays, GRID, GRID);
+        } else if (options.structure == "grid") {
+            game::add_grid(builder, x0, y0, options.bays, options.floors, GRID);
+        } else {
+            game::add_braced_frame(builder, x0, y0, options.floors, options.bays, GRID, GRID);
+        }
+        builder.build(system);
+
+        if (recorder) {
+            for (const auto& [a, b] : builder.edges()) {
+                recorder->record(0, game::EventType::CREATE_JOINT, 0, builder.x(a), builder.y(a), builder.x(b), builder.y(b));
+            }
+        }
+    }
+
+    // Applies the options to a newly created system
+    void configure(game::EarthquakeSystem<float>& system, const options_t& options) {
+        system.particle_system().set_solver_threads(options.threads);
+        system.particle_system().set_solver_config(options.solver);
+        system.particle_system().set_sleep_config({options.sleep_threshold, game::EarthquakeSystem<float>::SLEEP_STEPS});
+        system.particle_system().set_collision_config({options.collision_radius, true});
+        system.set_timestep_config(options.timestep);
+    }
+
+    // Loads the snapshot or builds the structure chosen by the options into a new or reset system
+    void prepare(game::EarthquakeSystem<float>& system, const options_t& options, const game::magnitudes_t& magnitudes) {
+        if (!options.load_path.empty()) {
+            // the snapshot brings its own magnitudes, the ones asked for take precedence
+            game::load_snapshot(system, options.load_path);
+            system.restore(system.run_time(), system.ground_dx(), system.ground_speed(), magnitudes.first, magnitudes.second);
+        } else {
+            build_structure(system, options, nullptr);
+        }
+    }
+
+    // Runs the same structure under each of options.magnitudes concurrently and reports every
+    // simulation. Each simulation runs options.runs times, reset and rebuilt between runs.
+    int run_instances(const options_t& options) {
+        using System = game::EarthquakeSystem<float>;
+        std::size_t count = options.magnitudes.size();
+        unsigned int jobs = options.jobs;
+        if (jobs == 0) {
+            jobs = static_cast<unsigned int>(std::min<std::size_t>(count, std::max(1u, std::thread::hardware_concurrency())));
+        }
+
+        game::SimulationPool<float> simulations(jobs);
+        try {
+            for (const game::magnitudes_t& magnitudes : options.magnitudes) {
+                System& system = simulations.add(options.width, options.height, DEFAULT_GROUND_LEVEL, magnitudes.first, magnitudes.second);
+                configure(system, options);
+                prepare(system, options, magnitudes);
+            }
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+
+        // each simulation runs all of its runs as a single job, rebuilding the structure is timed too
+        std::vector<unsigned long> iterations(count, 0);
+        std::vector<double> seconds(count, 0);
+        std::vector<std::exception_ptr> errors(count);
+        auto start = std::chrono::steady_clock::now();
+        simulations.for_each([&](std::size_t i, System& system) {
+            auto instance_start = std::chrono::steady_clock::now();
+            try {
+                for (unsigned int run = 0; run < options.runs; ++run) {
+                    if (run > 0) {
+                        system.reset();
+                        prepare(system, options, options.magnitudes[i]);
+                    }
+                    for (unsigned long step = 0; step < options.steps; ++step) {
+                        system.update(System::TIMESTEP);
+                        iterations[i] += system.particle_system().solver_stats().iterations;
+                    }
+                }
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+            seconds[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - instance_start).count();
+        });
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        for (const std::exception_ptr& error : errors) {
+            try {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+            } catch (std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        }
+        unsigned long steps = options.steps * options.runs;
+
+        // the whole run is a single frame of the profile
+        profiling::Profiler& profiler = profiling::Profiler::instance();
+        if (profiler.enabled()) {
+            profiler.end_frame();
+        }
+        profiler.close();
+
+        for (std::size_t i = 0; i < count; ++i) {
+            System& system = simulations[i];
+            const physics::SolverStats<float>& stats = system.particle_system().solver_stats();
+            std::cerr << "instance: " << i
+                      << " magnitudes: " << system.magnitude_x() << ":" << system.magnitude_y()
+                      << " particles: " << system.particles().size()
+                      << " joints: " << system.joints().size()
+                      << " steps: " << steps
+                      << " seconds: " << seconds[i]
+                      << " steps/sec: " << (seconds[i] > 0 ? steps / seconds[i] : 0)
+                      << " iterations/step: " << (steps > 0 ? double(iterations[i]) / steps : 0)
+                      << " max error: " << stats.max_error
+                      << " rms error: " << stats.rms_error
+                      << " asleep: " << system.particle_system().asleep_count()
+                      << std::endl;
+        }
+        std::cerr << "instances: " << count
+                  << " jobs: " << jobs
+                  << " runs: " << options.runs
+                  << " seconds: " << elapsed.count()
+                  << " steps/sec: " << (elapsed.count() > 0 ? count * steps / elapsed.count() : 0)
+                  << std::endl;
+
+        if (options.print_positions) {
+            for (std::size_t i = 0; i < count; ++i) {
+                if (count > 1) {
+                    std::cout << "instance " << i << "\n";
+                }
+                for (auto particle : simulations[i].particles()) {
+                    std::cout << particle.x() << " " << particle.y() << "\n";
+                }
+            }
+        }
+        return 0;
+    }
+}
+
+// Runs the simulation without a window and reports its performance
+int main(int argc, char** argv) {
+    options_t options;
+    if (!parse_options(argc, argv, options)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    using System = game::EarthquakeSystem<float>;
+
+    // A replayed session brings its own world
+    std::optional<game::EventReader> replay;
+    unsigned int ground_level = DEFAULT_GROUND_LEVEL;
+    double step_time = System::TIMESTEP;
+    profiling::Profiler& profiler = profiling::Profiler::instance();
+    try {
+        if (!options.profile_csv_path.empty()) {
+            profiler.open_csv(options.profile_csv_path);
+        }
+        if (!options.trace_path.empty()) {
+            profiler.open_trace(options.trace_path);
+        }
+        if (!options.replay_path.empty()) {
+            replay.emplace(options.replay_path);
+            const game::EventLogHeader& header = replay->header();
+            options.width = header.width;
+            options.height = header.height;
+            options.magnitude_x = header.magnitude_x;
+            options.magnitude_y = header.magnitude_y;
+            ground_level = header.ground_level;
+            step_time = header.step_time;
+        }
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    // repeated runs of a single simulation are a batch of one
+    if (options.magnitudes.empty() && options.runs > 1) {
+        options.magnitudes.push_back({options.magnitude_x, options.magnitude_y});
+    }
+    if (!options.magnitudes.empty()) {
+        return run_instances(options);
+    }
+
+    System system(options.width, options.height, ground_level, options.magnitude_x, options.magnitude_y);
+    configure(system, options);
+    if (replay) {
+        game::apply_event_log_settings(replay->header(), system.particle_system());
+    }
+    std::optional<game::EventRecorder> recorder;
+    game::AccelerogramMotion* accelerogram = nullptr;
+    try {
+        if (!options.record_path.empty()) {
+            recorder.emplace(options.record_path, game::event_log_header(options.width, options.height, ground_level,
+                options.magnitude_x, options.magnitude_y, step_time, system.particle_system()));
+        }
+        if (!options.load_path.empty()) {
+            game::load_snapshot(system, options.load_path);
+        } else if (!replay) {
+            build_structure(system, options, recorder ? &*recorder : nullptr);
+        }
+        if (!options.accelerogram_path.empty()) {
+            auto motion = std::make_unique<game::AccelerogramMotion>(game::open_accelerogram(options.accelerogram_path), options.gain);
+            accelerogram = motion.get();
+            system.set_ground_motion(std::move(motion));
+        }
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    // Frames are drawn here and written on the exporter's thread while the next steps run
+    std::optional<game::SoftwareRenderer> renderer;
+    std::optional<game::FrameExporter> exporter;
+    if (!options.video_path.empty()) {
+        renderer.emplace();
+        try {
+            renderer->load_textures(texture_utils::resource_path("sky.texture"), texture_utils::resource_path("brick.texture"));
+        } catch (std::exception& e) {
+            std::cerr << e.what() << ", drawing plain colours instead" << std::endl;
+        }
+        try {
+            exporter.emplace(options.video_path, PHYSICS_RATE, options.frame_every);
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // Strains are measured by the solver as it relaxes the joints and summed up after every step
+    std::optional<physics::StrainMetrics<float>> strains;
+    std::optional<physics::StrainLog<float>> strain_log;
+    if (!options.strain_log_path.empty()) {
+        system.particle_system().set_strain_tracking(true);
+        strains.emplace(options.strain);
+        try {
+            strain_log.emplace(options.strain_log_path, options.strain);
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // With an adaptive timestep the run lasts as long as options.steps steps of step_time and
+    // frames are drawn every options.frame_every * step_time of simulated time
+    unsigned long steps = 0;
+    unsigned long iterations = 0;
+    double simulated = 0;
+    double next_frame = 0;
+    double duration = options.steps * step_time;
+    auto start = std::chrono::steady_clock::now();
+    for (;; ++steps) {
+        if (replay) {
+            // apply the events that happened before this step, the session ends with the log
+            bool ended = false;
+            while (const game::Event* event = replay->peek()) {
+                if (event->step > steps) {
+                    break;
+                }
+                ended = ended || event->type == game::EventType::END;
+                game::apply_event(system, *event);
+                replay->pop();
+            }
+            if (ended || !replay->peek()) {
+                break;
+            }
+        }
+        bool draw = options.adaptive ? simulated >= next_frame - 1e-9 : steps % options.frame_every == 0;
+        if (exporter && draw) {
+            next_frame += options.frame_every * step_time;
+            long seconds = static_cast<long>((options.adaptive ? simulated / step_time + 1e-6 : steps) / PHYSICS_RATE);
+            try {
+                game::Framebuffer frame = exporter->acquire();
+                renderer->render(system, "Time: " + std::to_string(seconds) + "s", frame);
+                exporter->submit(std::move(frame));
+            } catch (std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        }
+        if (replay) {
+            // the session ended with the log
+        } else if (accelerogram && options.steps == 0) {
+            if (accelerogram->finished()) {
+                break;
+            }
+        } else if (options.adaptive ? simulated >= duration - 1e-9 : steps >= options.steps) {
+            break;
+        }
+        try {
+            double dt = step_time;
+            if (options.adaptive) {
+                // the rest of the run is split in equal steps so that the last one is not cut short
+                dt = system.next_timestep();
+                if (!accelerogram || options.steps != 0) {
+                    double remaining = duration - simulated;
+                    dt = remaining / std::ceil(remaining / dt - 1e-9);
+                }
+            }
+            system.update(dt);
+            simulated += dt;
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        iterations += system.particle_system().solver_stats().iterations;
+        if (strains) {
+            strains->update(system.particle_system().strains());
+            try {
+                strain_log->write(steps, system.run_time(), strains->last());
+            } catch (std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        }
+        // every step is a frame of the profile
+        if (profiler.enabled()) {
+            profiler.end_frame();
+        }
+    }
+    if (exporter) {
+        try {
+            exporter->finish();
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+    profiler.close();
+    if (recorder) {
+        recorder->record(steps, game::EventType::END);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    const physics::SolverStats<float>& stats = system.particle_system().solver_stats();
+
+    std::cerr << "particles: " << system.particles().size()
+              << " joints: " << system.joints().size()
+              << " steps: " << steps
+              << " seconds: " << elapsed.count()
+              << " steps/sec: " << (elapsed.count() > 0 ? steps / elapsed.count() : 0)
+              << " iterations/step: " << (steps > 0 ? double(iterations) / steps : 0)
+              << " max error: " << stats.max_error
+              << " rms error: " << stats.rms_error
+              << " asleep: " << system.particle_system().asleep_count()
+              << std::endl;
+    if (options.adaptive) {
+        std::cerr << "simulated time: " << simulated
+                  << " mean timestep: " << (steps > 0 ? simulated / steps : 0)
+                  << std::endl;
+    }
+    if (strains) {
+        float max_strain = 0;
+        for (std::size_t j = 0; j < strains->joint_count(); ++j) {
+            max_strain = std::max(max_strain, strains->max_strain(j));
+        }
+        std::cerr << "max strain: " << max_strain
+                  << " damaged joints: " << strains->damaged()
+                  << std::endl;
+    }
+
+    if (!options.save_path.empty()) {
+        try {
+            game::save_snapshot(system, options.save_path);
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    if (options.print_positions) {
+        for (auto particle : system.particles()) {
+            std::cout << particle.x() << " " << particle.y() << "\n";
+        }
+    }
+    return 0;
+}
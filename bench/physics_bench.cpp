@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "earthquake_system.hpp"
+#include "structure_builder.hpp"
+
+// Microbenchmarks for the hot paths of the physics code. Every benchmark is run on generated
+// structures of increasing size and reports the time per unit of work (particle, joint or query)
+// so that results for different sizes and different layouts can be compared directly.
+namespace {
+    using System = game::EarthquakeSystem<float>;
+    using Clock = std::chrono::steady_clock;
+
+    constexpr float GRID = 20;
+    constexpr unsigned int GROUND_LEVEL = 40;
+    constexpr float DT = 0.1;
+
+    struct options_t {
+        std::size_t max_particles = 100000;
+        int warmup = 2;
+        int repetitions = 5;
+        unsigned int threads = 1;
+        physics::simd::Level simd = physics::simd::detect_level();
+        std::string filter;
+    };
+
+    // Generates a structure of roughly the given number of particles standing on the ground of the system.
+    using generator_t = std::function<void(physics::ParticleSystem<float>&, std::size_t)>;
+
+    struct structure_t {
+        const char* name;
+        generator_t generate;
+        // size of the world needed for a structure of the given number of particles
+        std::function<std::pair<unsigned int, unsigned int>(std::size_t)> world_size;
+    };
+
+    // Marks the nodes of the bottom row of the builder fixed.
+    void fix_bottom(game::StructureBuilder<float>& builder, float ground) {
+        for (std::size_t i = 0; i < builder.node_count(); ++i) {
+            if (builder.y(i) == ground) {
+                builder.add_node(builder.x(i), ground, true);
+            }
+        }
+    }
+
+    // A cross braced tower three bays wide.
+    void generate_tower(physics::ParticleSystem<float>& system, std::size_t particles) {
+        const std::size_t columns = 4;
+        std::size_t floors = std::max<std::size_t>(particles / columns, 2);
+        float ground = system.bounding_box().ymin();
+        game::StructureBuilder<float> builder;
+        game::add_braced_frame(builder, GRID, ground, floors - 1, columns - 1, GRID, GRID);
+        fix_bottom(builder, ground);
+        builder.build(system);
+    }
+
+    // A square braced grid.
+    void generate_grid(physics::ParticleSystem<float>& system, std::size_t particles) {
+        std::size_t side = std::max<std::size_t>(std::sqrt(particles), 2);
+        float ground = system.bounding_box().ymin();
+        game::StructureBuilder<float> builder;
+        game::add_grid(builder, GRID, ground, side, side, GRID);
+        fix_bottom(builder, ground);
+        builder.build(system);
+    }
+
+    // A long horizontal chain hanging from a fixed particle at each end.
+    void generate_chain(physics::ParticleSystem<float>& system, std::size_t particles) {
+        particles = std::max<std::size_t>(particles, 2);
+        float top = system.bounding_box().ymax() - GRID;
+        game::StructureBuilder<float> builder;
+        builder.reserve(particles, particles - 1);
+        for (std::size_t i = 0; i < particles; ++i) {
+            builder.add_node(GRID + 2 * i, top, i == 0 || i + 1 == particles);
+            if (i > 0) {
+                builder.add_edge(i - 1, i);
+            }
+        }
+        builder.build(system);
+    }
+
+    const std::vector<structure_t> structures = {
+        {"tower", generate_tower, [](std::size_t n) {
+            return std::make_pair(640u, static_cast<unsigned int>(GROUND_LEVEL + GRID * (n / 4 + 2)));
+        }},
+        {"grid", generate_grid, [](std::size_t n) {
+            unsigned int side = GRID * (std::sqrt(n) + 2);
+            return std::make_pair(std::max(640u, side), std::max(480u, GROUND_LEVEL + side));
+        }},
+        {"chain", generate_chain, [](std::size_t n) {
+            return std::make_pair(std::max(640u, static_cast<unsigned int>(2 * GRID + 2 * n)), 480u);
+        }},
+    };
+
+    struct result_t {
+        double min;
+        double median;
+    };
+
+    // Runs fn (which performs units of work each call) warmup times then repetitions times, and
+    // returns the min and median time per unit in nanoseconds.
+    result_t measure(const options_t& options, double units, const std::function<void()>& fn) {
+        for (int i = 0; i < options.warmup; ++i) {
+            fn();
+        }
+        std::vector<double> samples;
+        for (int i = 0; i < options.repetitions; ++i) {
+            auto start = Clock::now();
+            fn();
+            std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+            samples.push_back(elapsed.count() / units);
+        }
+        std::sort(samples.begin(), samples.end());
+        return {samples.front(), samples[samples.size() / 2]};
+    }
+
+    void report(const char* benchmark, const structure_t& structure, System& system, result_t result, const char* unit) {
+        std::cout << std::left << std::setw(20) << benchmark
+                  << std::setw(8) << structure.name
+                  << std::right << std::setw(10) << system.particles().size()
+                  << std::setw(10) << system.joints().size()
+                  << std::fixed << std::setprecision(2)
+                  << std::setw(14) << result.min
+                  << std::setw(14) << result.median
+                  << "  " << unit << std::endl;
+    }
+
+    bool selected(const options_t& options, const char* benchmark) {
+        return options.filter.empty() || std::string(benchmark).find(options.filter) != std::string::npos;
+    }
+
+    // Number of simulation steps to run per repetition so that every repetition does a similar
+    // amount of work regardless of the size of the structure.
+    int steps_for(std::size_t particles) {
+        return std::clamp<std::size_t>(200000 / std::max<std::size_t>(particles, 1), 1, 1000);
+    }
+
+    void run(const options_t& options, const structure_t& structure, std::size_t size) {
+        auto [width, height] = structure.world_size(size);
+        auto make_system = [&]() {
+            auto system = std::make_unique<System>(width, height, GROUND_LEVEL, 3, 2);
+            structure.generate(system->particle_system(), size);
+            system->particle_system().set_solver_threads(options.threads);
+            return system;
+        };
+
+        std::unique_ptr<System> system = make_system();
+        physics::ParticleSystem<float>& particles = system->particle_system();
+        double n = particles.particle_count();
+        double joints = particles.joint_count();
+        int steps = steps_for(particles.particle_count());
+
+        if (selected(options, "build")) {
+            report("build", structure, *system, measure(options, n, [&]() {
+                make_system();
+            }), "ns/particle");
+        }
+
+        if (selected(options, "update")) {
+            report("update", structure, *system, measure(options, n * steps, [&]() {
+                for (int i = 0; i < steps; ++i) particles.update(DT);
+            }), "ns/particle/step");
+        }
+
+        if (selected(options, "earthquake_update")) {
+            report("earthquake_update", structure, *system, measure(options, n * steps, [&]() {
+                for (int i = 0; i < steps; ++i) system->update();
+            }), "ns/particle/step");
+        }
+
+        if (selected(options, "maintain_length") && joints > 0) {
+            report("maintain_length", structure, *system, measure(options, joints * steps, [&]() {
+                for (int i = 0; i < steps; ++i) {
+                    for (std::size_t j = 0; j < particles.joint_count(); ++j) {
+                        particles.maintain_length(j);
+                    }
+                }
+            }), "ns/joint/iteration");
+        }
+
+        if (selected(options, "integrate")) {
+            report("integrate", structure, *system, measure(options, n * steps, [&]() {
+                for (int i = 0; i < steps; ++i) particles.integrate(DT);
+            }), "ns/particle/step");
+        }
+
+        if (selected(options, "stay_in_bounds")) {
+            report("stay_in_bounds", structure, *system, measure(options, n * steps, [&]() {
+                for (int i = 0; i < steps; ++i) particles.stay_in_bounds();
+            }), "ns/particle/step");
+        }
+
+        // the fused pass shaking the ground, integrating and clamping that update(dt, dx, dy) runs,
+        // on copies of the particles so the structure is left as it was
+        if (selected(options, "shake_step")) {
+            std::vector<float> xs(particles.xs().begin(), particles.xs().end());
+            std::vector<float> ys(particles.ys().begin(), particles.ys().end());
+            std::vector<float> prev_xs(particles.prev_xs().begin(), particles.prev_xs().end());
+            std::vector<float> prev_ys(particles.prev_ys().begin(), particles.prev_ys().end());
+            std::vector<unsigned char> fixed(particles.fixed_flags().begin(), particles.fixed_flags().end());
+            std::vector<unsigned char> asleep(xs.size(), 0);
+            const auto& box = particles.bounding_box();
+            physics::simd::StepParams<float> params{1, 0, 0, -DT * DT, 1, box.xmin(), box.xmax(), box.ymin(), box.ymax()};
+            report("shake_step", structure, *system, measure(options, n * steps, [&]() {
+                for (int i = 0; i < steps; ++i) {
+                    params.ground_dx = -params.ground_dx;
+                    physics::simd::step<true>(xs.data(), ys.data(), prev_xs.data(), prev_ys.data(),
+                        fixed.data(), asleep.data(), xs.size(), params);
+                }
+            }), "ns/particle/step");
+        }
+
+        // lookups are run on a fresh structure so the queried positions hit existing particles
+        if (selected(options, "particle_near") || selected(options, "particle_at")) {
+            system = make_system();
+            physics::ParticleSystem<float>& fresh = system->particle_system();
+            std::mt19937 rng(475);
+            std::uniform_int_distribution<std::size_t> pick(0, fresh.particle_count() - 1);
+            std::vector<std::pair<float, float>> queries;
+            for (int i = 0; i < 1000; ++i) {
+                std::size_t p = pick(rng);
+                queries.emplace_back(fresh.x(p), fresh.y(p));
+            }
+
+            std::size_t found = 0;
+            if (selected(options, "particle_near")) {
+                report("particle_near", structure, *system, measure(options, queries.size(), [&]() {
+                    for (auto [x, y] : queries) found += fresh.particle_near(x + 1, y + 1, 10).has_value();
+                }), "ns/query");
+            }
+            if (selected(options, "particle_at")) {
+                report("particle_at", structure, *system, measure(options, queries.size(), [&]() {
+                    for (auto [x, y] : queries) found += fresh.particle_at(x, y).has_value();
+                }), "ns/query");
+            }
+            if (found == 0) {
+                std::cerr << "warning: lookups found no particles" << std::endl;
+            }
+        }
+    }
+
+    void usage(const char* program) {
+        std::cerr << "Usage: " << program << " [options]\n"
+                  << "  --max-particles N  largest structure to benchmark (default 100000)\n"
+                  << "  --warmup N         untimed runs before measuring (default 2)\n"
+                  << "  --repetitions N    timed runs per benchmark (default 5)\n"
+                  << "  --threads N        number of threads used to relax joints (default 1)\n"
+                  << "  --simd LEVEL       scalar, sse4.1 or avx2 (default: best supported)\n"
+                  << "  --filter NAME      only run benchmarks whose name contains NAME\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    options_t options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "--max-particles")     options.max_particles = std::stoul(value);
+        else if (arg == "--warmup")       options.warmup = std::stoi(value);
+        else if (arg == "--repetitions")  options.repetitions = std::max(1, std::stoi(value));
+        else if (arg == "--filter")       options.filter = value;
+        else if (arg == "--threads")      options.threads = std::max(1, std::stoi(value));
+        else if (arg == "--simd" && value == "scalar")  options.simd = physics::simd::Level::SCALAR;
+        else if (arg == "--simd" && value == "sse4.1")  options.simd = physics::simd::Level::SSE41;
+        else if (arg == "--simd" && value == "avx2")    options.simd = physics::simd::Level::AVX2;
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (options.simd > physics::simd::detect_level()) {
+        std::cerr << "This CPU does not support " << physics::simd::level_name(options.simd) << std::endl;
+        return 1;
+    }
+    physics::simd::active_level() = options.simd;
+    std::cout << "kernels: " << physics::simd::level_name(options.simd) << ", solver threads: " << options.threads << std::endl;
+
+    std::cout << std::left << std::setw(20) << "benchmark"
+              << std::setw(8) << "shape"
+              << std::right << std::setw(10) << "particles"
+              << std::setw(10) << "joints"
+              << std::setw(14) << "min"
+              << std::setw(14) << "median"
+              << "  unit" << std::endl;
+
+    for (const structure_t& structure : structures) {
+        for (std::size_t size = 10; size <= options.max_particles; size *= 10) {
+            run(options, structure, size);
+        }
+    }
+    return 0;
+}
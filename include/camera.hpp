@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+
+namespace game {
+
+// The part of the world shown in a viewport of a given size in pixels, y pointing up in both. The
+// camera looks at a point of the world with a zoom in pixels per world unit and is kept over the
+// world: zoomed in, the viewport never shows anything beyond the edges of the world, zoomed out
+// further than the whole world the world is centered.
+class Camera {
+public:
+	// Range of zoom levels relative to the zoom showing the whole world, or 1 if that is larger
+	static constexpr float MAX_ZOOM = 8;
+
+	// The camera shows the lower left corner of the world one pixel per unit, which is the whole
+	// world when it has the size of the viewport.
+	Camera(float viewport_width, float viewport_height, float world_width, float world_height) :
+		viewport_width_(viewport_width),
+		viewport_height_(viewport_height),
+		world_width_(world_width),
+		world_height_(world_height)
+	{
+		reset();
+	}
+
+	// Goes back to the view the camera was created with.
+	void reset(){
+		zoom_ = 1;
+		center_x_ = viewport_width_ / 2;
+		center_y_ = viewport_height_ / 2;
+		constrain();
+	}
+
+	// Moves the view by the given number of pixels.
+	void pan(float dx, float dy){
+		center_x_ += dx / zoom_;
+		center_y_ += dy / zoom_;
+		constrain();
+	}
+
+	// Multiplies the zoom by factor, keeping the point of the world under the given pixel where it is.
+	void zoom_at(float screen_x, float screen_y, float factor){
+		float world_x = to_world_x(screen_x);
+		float world_y = to_world_y(screen_y);
+		zoom_ = std::clamp(zoom_ * factor, min_zoom(), max_zoom());
+		center_x_ = world_x - (screen_x - viewport_width_ / 2) / zoom_;
+		center_y_ = world_y - (screen_y - viewport_height_ / 2) / zoom_;
+		constrain();
+	}
+
+	// Returns the world coordinates of the given pixel.
+	float to_world_x(float screen_x) const {
+		return center_x_ + (screen_x - viewport_width_ / 2) / zoom_;
+	}
+
+	float to_world_y(float screen_y) const {
+		return center_y_ + (screen_y - viewport_height_ / 2) / zoom_;
+	}
+
+	// Returns the visible part of the world, which may extend beyond the world when zoomed out.
+	float left() const {
+		return to_world_x(0);
+	}
+
+	float right() const {
+		return to_world_x(viewport_width_);
+	}
+
+	float bottom() const {
+		return to_world_y(0);
+	}
+
+	float top() const {
+		return to_world_y(viewport_height_);
+	}
+
+	// Pixels per world unit
+	float zoom() const {
+		return zoom_;
+	}
+
+	float world_width() const {
+		return world_width_;
+	}
+
+	float world_height() const {
+		return world_height_;
+	}
+
+private:
+	// Zoom showing the whole world, or 1 if the world is smaller than the viewport
+	float min_zoom() const {
+		return std::min({viewport_width_ / world_width_, viewport_height_ / world_height_, 1.f});
+	}
+
+	float max_zoom() const {
+		return std::max(min_zoom(), 1.f) * MAX_ZOOM;
+	}
+
+	// Keeps the view over the world along each axis, centered on it along an axis where the world
+	// is smaller than the view.
+	void constrain(){
+		center_x_ = constrain_axis(center_x_, viewport_width_ / zoom_, world_width_);
+		center_y_ = constrain_axis(center_y_, viewport_height_ / zoom_, world_height_);
+	}
+
+	static float constrain_axis(float center, float view, float world){
+		if(view >= world){
+			return world / 2;
+		}
+		return std::clamp(center, view / 2, world - view / 2);
+	}
+
+	float viewport_width_;
+	float viewport_height_;
+	float world_width_;
+	float world_height_;
+	float zoom_;
+	float center_x_;
+	float center_y_;
+};
+
+}
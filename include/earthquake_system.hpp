@@ -1,21 +1,57 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
-#include <list>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
 #include <cassert>
+#include <stdexcept>
 
+#include "ground_motion.hpp"
 #include "particle_system.hpp"
 #include "particle.hpp"
 #include "joint.hpp"
 
 namespace game {
 
+// radius of the particles of an EarthquakeSystem, which collide with each other and with joints,
+// see physics::CollisionConfig
+constexpr double COLLISION_RADIUS = 4;
+
+// Configures the adaptive timestep of an EarthquakeSystem, see EarthquakeSystem::next_timestep.
+// Steps are made as long as they can be without the ground or any particle moving by more than
+// max_distance in one, between min_timestep and max_timestep and at most growth times as long as
+// the previous step. The default distance is the radius particles collide with, so that they do
+// not pass through each other or through joints.
+struct TimestepConfig {
+	double max_distance = COLLISION_RADIUS;
+	double min_timestep = 0.1 / 16;
+	double max_timestep = 0.4;
+	double growth = 2;
+};
+
 // Represents a ParticleSystem specific to an earthquake simulation.
 template <typename T> class EarthquakeSystem {
 public:
 	// the upper boundary of the magnitude of the system (lower bound is 0)
 	static const int MAGNITUDE_UPPER_BOUND = 9;
 
+	// spacing of the grid structures are built on
+	static constexpr int GRID_SIZE = 20;
+
+	// default simulated time of a step, the magnitudes of the earthquake are tuned for it
+	static constexpr double TIMESTEP = 0.1;
+
+	// structures whose mean kinetic energy per particle stays below SLEEP_THRESHOLD for
+	// SLEEP_STEPS steps are put to sleep until the ground moves them, see physics::SleepConfig
+	static constexpr double SLEEP_THRESHOLD = 1e-4;
+	static constexpr int SLEEP_STEPS = 30;
+
+	// radius of the particles, see game::COLLISION_RADIUS
+	static constexpr double COLLISION_RADIUS = game::COLLISION_RADIUS;
+
 	// Creates a new EarthquakeSystem with the given width, height, *realistic* gravity and an
 	// inital ground level which particles position's may not go below.
 	EarthquakeSystem(
@@ -25,92 +61,117 @@ public:
 		unsigned int magnitude_x = 1,
 		unsigned int magnitude_y = 1
 	) :
+		init_ground_level_(init_ground_level),
 		run_time_(0),
 		ground_dx_(0),
+		ground_speed_(0),
 		magnitude_x_(magnitude_x),
 		magnitude_y_(magnitude_y),
-		system_(physics::ParticleSystem<T>(0, width, init_ground_level, height, 0, -1))
+		motion_(nullptr),
+		system_(0, width, init_ground_level, height, 0, -1, GRID_SIZE)
 	{
 		assert(magnitude_x_ <= MAGNITUDE_UPPER_BOUND);
 		assert(magnitude_y_ <= MAGNITUDE_UPPER_BOUND);
+		system_.set_sleep_config(physics::SleepConfig<T>{T(SLEEP_THRESHOLD), SLEEP_STEPS});
+		system_.set_collision_config(physics::CollisionConfig<T>{T(COLLISION_RADIUS), true});
 	}
 
-	physics::Particle<T>* particle_near(T x, T y, T radius = 1){
+	std::optional<physics::Particle<T>> particle_near(T x, T y, T radius = 1){
 		return system_.particle_near(x, y, radius);
 	}
 
 	// Creates a particle in the system. If the particle is on the ground (ie: y = 0), then it is
-	// fixed. Returns a reference to the particle created. If the particle is already in the system
-	// then it is not added again and reference to that particle is returned.
-	physics::Particle<T>& create_particle(T x, T y){
-		if(!system_.particle_at(x, y)){
-			return system_.create_particle(x, y, y <= ground_height() ? true : false);
+	// fixed. Returns a view of the particle created. If the particle is already in the system
+	// then it is not added again and a view of that particle is returned.
+	physics::Particle<T> create_particle(T x, T y){
+		if(std::optional<physics::Particle<T>> p = system_.particle_at(x, y)){
+			return *p;
 		}
-		return *system_.particle_at(x, y);
+		return system_.create_particle(x, y, y <= ground_height() ? true : false);
 	}
 
 	// Creates a joint in the system between two particles. If particles do not exist at the given
 	// coordinates, then particles are created at them first. If particles already exist at the
 	// given coordinates, new particles are not created.
 	void create_joint(T x1, T y1, T x2, T y2){
-		physics::Particle<T>* p1 = system_.particle_at(x1, y1);
-		if(!p1){
-			p1 = &create_particle(x1, y1);
-		}
-		
-		physics::Particle<T>* p2 = system_.particle_at(x2, y2);
-		if(!p2){
-			p2 = &create_particle(x2, y2);
-		}
+		physics::Particle<T> p1 = create_particle(x1, y1);
+		physics::Particle<T> p2 = create_particle(x2, y2);
 		try {
-			system_.create_joint(*p1, *p2);
+			system_.create_joint(p1, p2);
 		} catch(...){}
 		
 	}
 
-	// Updates the simulation by one timestep.
-	void update(){
-		run_time_ += 0.1;
+	// Updates the simulation by one timestep of dt. Shaking the ground is fused with the particle
+	// system's integration so the particles are only walked once.
+	// Throws std::invalid_argument if dt is not positive, the system is unchanged then.
+	void update(double dt = TIMESTEP){
+		if(!(dt > 0)){
+			throw std::invalid_argument("Timestep must be positive.");
+		}
+		run_time_ += dt;
 
-		shake_ground();
-		system_.update(0.1);
+		std::pair<T, T> motion = ground_motion(dt);
+		ground_dx_ += motion.first;
+		ground_speed_ = std::sqrt(motion.first * motion.first + motion.second * motion.second) / dt;
+		system_.update(dt, motion.first, motion.second);
 	}
 
-	// Moves the particles touching the ground a set amount depending on the system's run time.
-	// This creates a shaking effect over subsequent calls. Also moves the ground up and down if
-	// the vertical magnitude of the earthquake is greater than 0.
-	void shake_ground(){
-		T dx = magnitude_x_ * 1.6 * std::sin(run_time_ * 1.3 * magnitude_x_);
-		T dy = magnitude_y_ * 1.1 * std::sin(run_time_ * 1.4 * magnitude_y_);
+	// Sets how next_timestep chooses the timestep, see TimestepConfig.
+	void set_timestep_config(const TimestepConfig& config){
+		timestep_config_ = config;
+	}
 
-		// update bounding box of system
-		system_.move_lower_bound(0, dy);
+	const TimestepConfig& timestep_config() const {
+		return timestep_config_;
+	}
 
-		// update ground position
-		ground_dx_ += dx;
+	// Returns the timestep to update the system by for neither the ground nor any particle to move
+	// farther than TimestepConfig::max_distance, judging by their speeds during the last step.
+	// Calm scenes get long steps and violent ones short steps. The first step is at most TIMESTEP.
+	double next_timestep(){
+		const TimestepConfig& config = timestep_config_;
+		double last = system_.last_timestep();
+		double speed = ground_speed_;
+		if(last > 0){
+			speed = std::max(speed, system_.max_displacement() / last);
+		}
+		double dt = speed > 0 ? config.max_distance / speed : config.max_timestep;
+		dt = std::min(dt, last > 0 ? last * config.growth : TIMESTEP);
+		return std::clamp(dt, config.min_timestep, config.max_timestep);
+	}
 
-		// Move particles touching the ground.
-		// Do to floating point inaccuracies, we need to update fixed particles differently.
-		for(auto& particle : system_.particles()){
-			if(particle.fixed()){
-				particle.set_position(particle.x() + dx, system_.bounding_box().ymin());
-			}
-			else if(particle.y() <= system_.bounding_box().ymin()){
-				particle.move(dx, dy);
-			}
+	// Advances the system by duration, eg: the simulated time of a frame, in as many equal steps
+	// as next_timestep requires. Returns the number of steps taken.
+	// Throws std::invalid_argument if duration is not positive, the system is unchanged then.
+	unsigned int advance(double duration){
+		if(!(duration > 0)){
+			throw std::invalid_argument("Duration must be positive.");
 		}
+		// the tolerance keeps rounding errors from adding a step when duration is a multiple of it
+		double dt = next_timestep();
+		unsigned int steps = std::max(1u, static_cast<unsigned int>(std::ceil(duration / dt - 1e-9)));
+		for(unsigned int step = 0; step < steps; ++step){
+			update(duration / steps);
+		}
+		return steps;
 	}
 
-	// Returns a reference to the list of all particles in the system.
-	std::list<physics::Particle<T>>& particles(){
+	// Returns a range over all particles in the system.
+	physics::ParticleRange<T> particles(){
 		return system_.particles();
 	}
 
-	// Returns a reference to the list of all joints in the system.
-	std::list<physics::Joint<T>>& joints(){
+	// Returns a range over all joints in the system.
+	physics::JointRange<T> joints(){
 		return system_.joints();
 	}
 
+	// Returns the underlying particle system.
+	physics::ParticleSystem<T>& particle_system(){
+		return system_;
+	}
+
 	// Returns the current height of the ground.
 	T ground_height(){
 		return system_.bounding_box().ymin();
@@ -136,6 +197,46 @@ public:
 		return ground_dx_;
 	}
 
+	// Returns the distance the ground moved by per unit of time during the last step, which
+	// next_timestep starts from.
+	T ground_speed(){
+		return ground_speed_;
+	}
+
+	// Returns the total simulated time the system has been running for.
+	T run_time(){
+		return run_time_;
+	}
+
+	// Removes every particle and joint, brings the ground back to its initial level, the run time
+	// back to 0 and the ground motion set with set_ground_motion back to its start, keeping the
+	// magnitudes, the configuration and the memory of the system for the next scene (see
+	// ParticleSystem::clear). The next run is then the same as the first run of a new system.
+	// Throws std::runtime_error if the ground motion can not be rewound.
+	void reset(){
+		if(motion_){
+			motion_->rewind();
+		}
+		system_.clear();
+		system_.move_lower_bound(0, T(init_ground_level_) - ground_height());
+		run_time_ = 0;
+		ground_dx_ = 0;
+		ground_speed_ = 0;
+	}
+
+	// Restores the state of the earthquake, eg: from a snapshot. The particles and joints are
+	// restored through particle_system().
+	void restore(T run_time, T ground_dx, T ground_speed, unsigned int magnitude_x, unsigned int magnitude_y){
+		if(magnitude_x > MAGNITUDE_UPPER_BOUND || magnitude_y > MAGNITUDE_UPPER_BOUND){
+			throw std::invalid_argument("Magnitude is out of bounds.");
+		}
+		run_time_ = run_time;
+		ground_dx_ = ground_dx;
+		ground_speed_ = ground_speed;
+		magnitude_x_ = magnitude_x;
+		magnitude_y_ = magnitude_y;
+	}
+
 	unsigned int magnitude_x(){
 		return magnitude_x_;
 	}
@@ -144,19 +245,55 @@ public:
 		return magnitude_y_;
 	}
 
+	// Drives the ground with the given motion, eg: an AccelerogramMotion, instead of the sinusoids
+	// of the magnitudes, which then have no effect. The motion is advanced by every step from now
+	// on, whatever the run time. A null motion restores the sinusoids.
+	void set_ground_motion(std::unique_ptr<GroundMotion> motion){
+		motion_ = std::move(motion);
+	}
+
+	// Returns the motion driving the ground, or nullptr if it follows the magnitudes.
+	GroundMotion* ground_motion_source(){
+		return motion_.get();
+	}
+
 private:
+	// Returns the horizontal and vertical distance the ground moves by in a timestep of dt
+	// ending at the current run time.
+	std::pair<T, T> ground_motion(double dt){
+		if(motion_){
+			auto [dx, dy] = motion_->advance(dt);
+			return {T(dx), T(dy)};
+		}
+		T dx = magnitude_x_ * 1.6 * std::sin(run_time_ * 1.3 * magnitude_x_) * (dt / TIMESTEP);
+		T dy = magnitude_y_ * 1.1 * std::sin(run_time_ * 1.4 * magnitude_y_) * (dt / TIMESTEP);
+		return {dx, dy};
+	}
+
+	// level of the ground when the system was created
+	unsigned int init_ground_level_;
+
 	// total time system has been running
 	T run_time_;
 
 	// the amount to the left of the right the ground has moved
 	T ground_dx_;
 
+	// distance the ground moved by per unit of time during the last step
+	T ground_speed_;
+
+	// how next_timestep chooses the timestep
+	TimestepConfig timestep_config_;
+
 	// horizontal magnitude of earthquake
 	unsigned int magnitude_x_;
 
 	// vertical magnitude of earthquake
 	unsigned int magnitude_y_;
 
+	// motion driving the ground instead of the magnitudes, if any
+	std::unique_ptr<GroundMotion> motion_;
+
 	// underlying particle system
 	physics::ParticleSystem<T> system_;
 };
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+#include "earthquake_system.hpp"
+
+namespace game {
+
+// Kinds of events that change the course of a simulation.
+enum class EventType : std::uint32_t {
+	CREATE_PARTICLE,    // create_particle(x1, y1)
+	CREATE_JOINT,       // create_joint(x1, y1, x2, y2)
+	START,              // the simulation starts running
+	STOP,               // the simulation stops running
+	MAGNITUDE_X,        // inc_magnitude_x(delta)
+	MAGNITUDE_Y,        // inc_magnitude_y(delta)
+	END                 // the session ends, the last event of a complete log
+};
+
+// An event and the simulation step it happened before, counting the steps run since the start of
+// the session. Events of the same step are applied in the order they were recorded.
+struct Event {
+	std::uint64_t step;
+	EventType type;
+	std::int32_t delta;
+	float x1;
+	float y1;
+	float x2;
+	float y2;
+};
+static_assert(sizeof(Event) == 32, "Event must match the file layout");
+
+// Header at the start of an event log: the world the session started with, the simulated time of
+// each of its steps and every setting of the physics that changes the course of the simulation
+// (see physics::SolverConfig, SleepConfig and CollisionConfig, and the number of solver threads,
+// which decides the order joints are relaxed in). It is followed by the events in the order they
+// happened, each stored as an Event in the byte order of the machine that recorded it.
+struct EventLogHeader {
+	char magic[4];
+	std::uint32_t version;
+	std::uint32_t width;
+	std::uint32_t height;
+	std::uint32_t ground_level;
+	std::uint32_t magnitude_x;
+	std::uint32_t magnitude_y;
+	std::uint32_t reserved;
+	double step_time;
+	std::int32_t min_iterations;
+	std::int32_t max_iterations;
+	double tolerance;
+	double sleep_threshold;
+	std::int32_t sleep_steps;
+	std::uint32_t solver_threads;
+	double collision_radius;
+	std::uint32_t collide_joints;
+	std::uint32_t reserved2;
+};
+static_assert(sizeof(EventLogHeader) == 88, "EventLogHeader must match the file layout");
+
+constexpr char EVENT_LOG_MAGIC[4] = {'E', 'Q', 'E', 'V'};
+constexpr std::uint32_t EVENT_LOG_VERSION = 2;
+
+// Returns the header of a log of a session in the given world, run with the settings of system.
+template <class T> EventLogHeader event_log_header(unsigned int width, unsigned int height, unsigned int ground_level,
+		unsigned int magnitude_x, unsigned int magnitude_y, double step_time, const physics::ParticleSystem<T>& system){
+	EventLogHeader header{};
+	std::memcpy(header.magic, EVENT_LOG_MAGIC, sizeof(EVENT_LOG_MAGIC));
+	header.version = EVENT_LOG_VERSION;
+	header.width = width;
+	header.height = height;
+	header.ground_level = ground_level;
+	header.magnitude_x = magnitude_x;
+	header.magnitude_y = magnitude_y;
+	header.step_time = step_time;
+	header.min_iterations = system.solver_config().min_iterations;
+	header.max_iterations = system.solver_config().max_iterations;
+	header.tolerance = system.solver_config().tolerance;
+	header.sleep_threshold = system.sleep_config().threshold;
+	header.sleep_steps = system.sleep_config().steps;
+	header.solver_threads = system.solver_threads();
+	header.collision_radius = system.collision_config().radius;
+	header.collide_joints = system.collision_config().joints;
+	return header;
+}
+
+// Gives system the settings of the physics the session logged with header was recorded with, so
+// that replaying it reproduces the session whatever the system was configured with before.
+template <class T> void apply_event_log_settings(const EventLogHeader& header, physics::ParticleSystem<T>& system){
+	system.set_solver_config(physics::SolverConfig<T>{header.min_iterations, header.max_iterations, T(header.tolerance)});
+	system.set_sleep_config(physics::SleepConfig<T>{T(header.sleep_threshold), header.sleep_steps});
+	system.set_collision_config(physics::CollisionConfig<T>{T(header.collision_radius), header.collide_joints != 0});
+	system.set_solver_threads(header.solver_threads);
+}
+
+// Appends the events of a session to a log file. Every event is flushed as it is recorded so the
+// log survives the program crashing.
+class EventRecorder {
+public:
+	// Creates the log file at path, replacing any existing file.
+	// Throws std::runtime_error if the file can not be created.
+	EventRecorder(const std::string& path, const EventLogHeader& header) :
+		file_(path, std::ios::binary | std::ios::trunc)
+	{
+		file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file_.flush();
+		if(!file_){
+			throw std::runtime_error("Could not create event log " + path);
+		}
+	}
+
+	void record(const Event& event){
+		file_.write(reinterpret_cast<const char*>(&event), sizeof(event));
+		file_.flush();
+	}
+
+	void record(std::uint64_t step, EventType type, std::int32_t delta = 0, float x1 = 0, float y1 = 0, float x2 = 0, float y2 = 0){
+		record(Event{step, type, delta, x1, y1, x2, y2});
+	}
+
+private:
+	std::ofstream file_;
+};
+
+// Reads the events of a log file one at a time, so logs of any length can be replayed.
+class EventReader {
+public:
+	// Opens the log file at path and reads its header.
+	// Throws std::runtime_error if the file can not be read or is not an event log.
+	explicit EventReader(const std::string& path) :
+		file_(path, std::ios::binary)
+	{
+		if(!file_.read(reinterpret_cast<char*>(&header_), sizeof(header_))){
+			throw std::runtime_error("Could not read event log " + path);
+		}
+		if(std::memcmp(header_.magic, EVENT_LOG_MAGIC, sizeof(EVENT_LOG_MAGIC)) != 0){
+			throw std::runtime_error("Not an event log " + path);
+		}
+		if(header_.version != EVENT_LOG_VERSION){
+			throw std::runtime_error("Unsupported event log version " + path);
+		}
+		advance();
+	}
+
+	const EventLogHeader& header() const {
+		return header_;
+	}
+
+	// Returns the next event of the log, or nullptr once every event has been read. A log cut
+	// short (eg: by a crash) ends at its last complete event.
+	const Event* peek() const {
+		return next_ ? &*next_ : nullptr;
+	}
+
+	// Moves on to the event after the one returned by peek().
+	void pop(){
+		advance();
+	}
+
+private:
+	void advance(){
+		Event event;
+		if(file_.read(reinterpret_cast<char*>(&event), sizeof(event))){
+			next_ = event;
+		}
+		else {
+			next_ = std::nullopt;
+		}
+	}
+
+	std::ifstream file_;
+	EventLogHeader header_;
+	std::optional<Event> next_;
+};
+
+// Applies an event that changes the system. Events about the state of the session (START, STOP and
+// END) are left to the caller.
+template <class T> void apply_event(EarthquakeSystem<T>& system, const Event& event){
+	switch(event.type){
+		case EventType::CREATE_PARTICLE:
+			system.create_particle(event.x1, event.y1);
+			break;
+		case EventType::CREATE_JOINT:
+			system.create_joint(event.x1, event.y1, event.x2, event.y2);
+			break;
+		case EventType::MAGNITUDE_X:
+			system.inc_magnitude_x(event.delta);
+			break;
+		case EventType::MAGNITUDE_Y:
+			system.inc_magnitude_y(event.delta);
+			break;
+		default:
+			break;
+	}
+}
+
+}
@@ -1,10 +1,11 @@
 #pragma once
 #include <stdlib.h>
 #include <stdio.h>
-#include <string>
-#include <map>
+#include <algorithm>
+#include <vector>
 #include <pango/pangocairo.h>
 #include "texture_utils.hpp"
+#include "profiler.hpp"
 
 
 namespace game {
@@ -12,9 +13,36 @@ namespace game {
 
     // Adapted for C++ from https://dthompson.us/font-rendering-in-opengl-with-pango-and-cairo.html
     // This class is used to render text to the screen.
+    // Every printable ASCII glyph is rasterized once into a single atlas texture the first time text
+    // is printed, strings are then drawn as one batch of textured quads. The memory used is fixed no
+    // matter how many different strings are printed.
     class FontController {
         private:
-            std::map<std::string, texture_utils::texture_info_t> textures;
+            // First and last character in the atlas, other characters are drawn as FALLBACK_CHAR
+            static constexpr char FIRST_CHAR = ' ';
+            static constexpr char LAST_CHAR = '~';
+            static constexpr char FALLBACK_CHAR = '?';
+            static constexpr int GLYPH_COUNT = LAST_CHAR - FIRST_CHAR + 1;
+
+            // Number of glyphs per row of the atlas
+            static constexpr int ATLAS_COLUMNS = 16;
+
+            // Position of a glyph in the atlas in texture coordinates and its advance in pixels.
+            // Every glyph is glyph_height pixels high.
+            struct glyph_t {
+                float s0;
+                float t0;
+                float s1;
+                float t1;
+                int advance;
+            };
+
+            texture_utils::texture_info_t atlas = {0, 0, 0};
+            glyph_t glyphs[GLYPH_COUNT];
+            int glyph_height = 0;
+
+            // Interleaved x, y, s, t of the quads of the string being printed, kept between calls
+            std::vector<float> vertices;
 
             cairo_t* create_cairo_context(int width, int height, int channels, cairo_surface_t** surf, unsigned char** buffer) {
                 *buffer = (unsigned char*)calloc(channels * width * height, sizeof (unsigned char));
@@ -44,10 +72,8 @@ namespace game {
                 *height /= PANGO_SCALE;
             }
 
-            // Handles everything needed to turn text into a texture
-            // Returns the new texture ID, text width, and text height
-            texture_utils::texture_info_t render_text (const char *text) {
-                int texture_id;
+            // Rasterizes every glyph into the atlas texture and records where each one is
+            void build_atlas() {
                 int text_width;
                 int text_height;
                 unsigned char* surface_data = NULL;
@@ -55,29 +81,57 @@ namespace game {
                 cairo_t *layout_context;
                 cairo_t *render_context;
                 cairo_surface_t *surface;
-                
+
                 PangoFontDescription *desc;
                 PangoLayout *layout;
 
                 layout_context = create_layout_context();
 
-                /* Create a PangoLayout, set the font and text */
+                /* Create a PangoLayout and load the font */
                 layout = pango_cairo_create_layout(layout_context);
-                pango_layout_set_text(layout, text, -1);
-
-                /* Load the font */
                 desc = pango_font_description_from_string(FONT);
                 pango_layout_set_font_description(layout, desc);
                 pango_font_description_free(desc);
 
-                /* Get text dimensions and create a context to render to */
-                get_text_size(layout, &text_width, &text_height);
-                render_context = create_cairo_context(text_width, text_height, 4, &surface, &surface_data);
+                /* Measure every glyph to size the cells of the atlas */
+                int advances[GLYPH_COUNT];
+                int cell_width = 1;
+                glyph_height = 1;
+                for (int i = 0; i < GLYPH_COUNT; ++i) {
+                    char text[2] = {static_cast<char>(FIRST_CHAR + i), '\0'};
+                    pango_layout_set_text(layout, text, -1);
+                    get_text_size(layout, &text_width, &text_height);
+                    advances[i] = text_width;
+                    cell_width = std::max(cell_width, text_width);
+                    glyph_height = std::max(glyph_height, text_height);
+                }
 
-                /* Render */
+                /* Create a context to render the atlas to */
+                int rows = (GLYPH_COUNT + ATLAS_COLUMNS - 1) / ATLAS_COLUMNS;
+                int atlas_width = ATLAS_COLUMNS * cell_width;
+                int atlas_height = rows * glyph_height;
+                render_context = create_cairo_context(atlas_width, atlas_height, 4, &surface, &surface_data);
                 cairo_set_source_rgba (render_context, 1, 1, 1, 1);
-                pango_cairo_show_layout (render_context, layout);
-                texture_id = texture_utils::create_texture(text_width, text_height, surface_data, GL_RGBA);
+
+                /* Render each glyph into its cell */
+                for (int i = 0; i < GLYPH_COUNT; ++i) {
+                    char text[2] = {static_cast<char>(FIRST_CHAR + i), '\0'};
+                    int x = (i % ATLAS_COLUMNS) * cell_width;
+                    int y = (i / ATLAS_COLUMNS) * glyph_height;
+                    pango_layout_set_text(layout, text, -1);
+                    cairo_move_to(render_context, x, y);
+                    pango_cairo_show_layout(render_context, layout);
+                    glyphs[i] = {
+                        float(x) / atlas_width,
+                        float(y) / atlas_height,
+                        float(x + advances[i]) / atlas_width,
+                        float(y + glyph_height) / atlas_height,
+                        advances[i]
+                    };
+                }
+                cairo_surface_flush(surface);
+                unsigned int texture_id = texture_utils::create_texture(atlas_width, atlas_height, surface_data, GL_RGBA);
+                atlas = {texture_id, static_cast<unsigned int>(atlas_width), static_cast<unsigned int>(atlas_height)};
 
                 /* Clean up */
                 free(surface_data);
@@ -85,22 +139,54 @@ namespace game {
                 cairo_destroy(layout_context);
                 cairo_destroy(render_context);
                 cairo_surface_destroy(surface);
+            }
 
-                return {texture_id, text_width, text_height};
+            const glyph_t& glyph(char c) const {
+                if (c < FIRST_CHAR || c > LAST_CHAR) {
+                    c = FALLBACK_CHAR;
+                }
+                return glyphs[c - FIRST_CHAR];
             }
 
         public:
-            // Renders the given text to the screen at (x,y). Text is cached for performance but new strings can be slow on the first sighting
+            // Renders the given text to the screen with its bottom left corner at (x,y) in the current color
             void glPrint(const int x, const int y, const char *text) {
-                texture_utils::texture_info_t info;
-                if (textures.find(text) == textures.end()) {
-                    info = render_text(text);
-                    textures[text] = info;
+                PROFILE_SCOPE("text");
+                if (atlas.id == 0) {
+                    build_atlas();
                 }
-                else {
-                    info = textures[text];
+
+                // Texture coordinate t grows downwards in the atlas, like the rows of the rasterized glyphs
+                vertices.clear();
+                float x0 = x;
+                float y0 = y;
+                float y1 = y + glyph_height;
+                for (const char* c = text; *c != '\0'; ++c) {
+                    const glyph_t& g = glyph(*c);
+                    float x1 = x0 + g.advance;
+                    vertices.insert(vertices.end(), {
+                        x0, y1, g.s0, g.t0,
+                        x0, y0, g.s0, g.t1,
+                        x1, y0, g.s1, g.t1,
+                        x1, y1, g.s1, g.t0
+                    });
+                    x0 = x1;
                 }
-                texture_utils::draw_texture(x, y, info);
+
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                glBindTexture(GL_TEXTURE_2D, atlas.id);
+                glEnable(GL_TEXTURE_2D);
+                glEnableClientState(GL_VERTEX_ARRAY);
+                glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+                glVertexPointer(2, GL_FLOAT, 4 * sizeof(float), vertices.data());
+                glTexCoordPointer(2, GL_FLOAT, 4 * sizeof(float), vertices.data() + 2);
+                glDrawArrays(GL_QUADS, 0, static_cast<GLsizei>(vertices.size() / 4));
+                glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+                glDisableClientState(GL_VERTEX_ARRAY);
+                glDisable(GL_TEXTURE_2D);
+                glBindTexture(GL_TEXTURE_2D, 0);
+                glDisable(GL_BLEND);
             }
     };
 }
\ No newline at end of file
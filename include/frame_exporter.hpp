@@ -0,0 +1,372 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "profiler.hpp"
+#include "software_renderer.hpp"
+
+namespace game {
+
+// Writes a frame as a PNG file. The image data is stored uncompressed (a zlib stream of stored
+// blocks) so that no compression library is needed and writing costs little more than copying.
+// Throws std::runtime_error if the file cannot be written.
+inline void write_png(const std::string& path, const Framebuffer& frame){
+	static const std::array<std::uint32_t, 256> crc_table = []{
+		std::array<std::uint32_t, 256> table{};
+		for(std::uint32_t n = 0; n < 256; ++n){
+			std::uint32_t c = n;
+			for(int k = 0; k < 8; ++k){
+				c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			}
+			table[n] = c;
+		}
+		return table;
+	}();
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if(!file){
+		throw std::runtime_error("Could not open frame file " + path);
+	}
+	auto put32 = [](std::vector<std::uint8_t>& out, std::uint32_t value){
+		out.push_back(value >> 24);
+		out.push_back(value >> 16);
+		out.push_back(value >> 8);
+		out.push_back(value);
+	};
+	// writes a chunk of the given type holding data, followed by its CRC
+	std::vector<std::uint8_t> chunk;
+	auto write_chunk = [&](const char* type, const std::vector<std::uint8_t>& data){
+		chunk.clear();
+		put32(chunk, static_cast<std::uint32_t>(data.size()));
+		chunk.insert(chunk.end(), type, type + 4);
+		chunk.insert(chunk.end(), data.begin(), data.end());
+		std::uint32_t crc = 0xFFFFFFFFu;
+		for(std::size_t i = 4; i < chunk.size(); ++i){
+			crc = crc_table[(crc ^ chunk[i]) & 0xFF] ^ (crc >> 8);
+		}
+		put32(chunk, crc ^ 0xFFFFFFFFu);
+		file.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+	};
+
+	static const char signature[8] = {'\x89', 'P', 'N', 'G', '\r', '\n', '\x1A', '\n'};
+	file.write(signature, sizeof(signature));
+
+	// 8 bits per channel RGB, no interlacing
+	std::vector<std::uint8_t> header;
+	put32(header, frame.width);
+	put32(header, frame.height);
+	header.insert(header.end(), {8, 2, 0, 0, 0});
+	write_chunk("IHDR", header);
+
+	// every row starts with the filter type, none
+	std::size_t stride = std::size_t(frame.width) * 3;
+	std::vector<std::uint8_t> raw;
+	raw.reserve((stride + 1) * frame.height);
+	for(unsigned int y = 0; y < frame.height; ++y){
+		raw.push_back(0);
+		raw.insert(raw.end(), frame.row(y), frame.row(y) + stride);
+	}
+	std::vector<std::uint8_t> data = {0x78, 0x01};
+	data.reserve(raw.size() + raw.size() / 65535 * 5 + 11);
+	std::size_t offset = 0;
+	do {
+		std::size_t length = std::min<std::size_t>(raw.size() - offset, 65535);
+		data.push_back(offset + length == raw.size() ? 1 : 0);
+		data.push_back(length & 0xFF);
+		data.push_back(length >> 8);
+		data.push_back(~length & 0xFF);
+		data.push_back((~length >> 8) & 0xFF);
+		data.insert(data.end(), raw.begin() + offset, raw.begin() + offset + length);
+		offset += length;
+	} while(offset < raw.size());
+	std::uint32_t a = 1;
+	std::uint32_t b = 0;
+	for(std::uint8_t byte : raw){
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	put32(data, (b << 16) | a);
+	write_chunk("IDAT", data);
+	write_chunk("IEND", {});
+
+	if(!file){
+		throw std::runtime_error("Could not write frame file " + path);
+	}
+}
+
+// Writes frames one after another as an uncompressed YUV4MPEG2 stream, which video tools read
+// directly, eg: ffmpeg -i run.y4m run.mp4. Pixels are converted to 4:2:0 with the BT.601 limited
+// range coefficients.
+class Y4mWriter {
+public:
+	// Opens the stream at path to be played at rate_numerator / rate_denominator frames per second.
+	// Throws std::runtime_error if the file cannot be opened.
+	Y4mWriter(const std::string& path, unsigned int rate_numerator, unsigned int rate_denominator) :
+		path_(path), file_(path, std::ios::binary | std::ios::trunc),
+		rate_numerator_(rate_numerator), rate_denominator_(rate_denominator)
+	{
+		if(!file_){
+			throw std::runtime_error("Could not open video file " + path);
+		}
+	}
+
+	// Appends a frame, every frame must have the size of the first one.
+	// Throws std::runtime_error if the frame cannot be written.
+	void write(const Framebuffer& frame){
+		if(width_ == 0){
+			width_ = frame.width;
+			height_ = frame.height;
+			file_ << "YUV4MPEG2 W" << width_ << " H" << height_ << " F" << rate_numerator_ << ":" << rate_denominator_
+				<< " Ip A1:1 C420jpeg\n";
+		}
+		else if(frame.width != width_ || frame.height != height_){
+			throw std::runtime_error("Frames of a video must all have the same size");
+		}
+
+		unsigned int chroma_width = (width_ + 1) / 2;
+		unsigned int chroma_height = (height_ + 1) / 2;
+		luma_.resize(std::size_t(width_) * height_);
+		cb_.resize(std::size_t(chroma_width) * chroma_height);
+		cr_.resize(std::size_t(chroma_width) * chroma_height);
+		for(unsigned int y = 0; y < height_; ++y){
+			const std::uint8_t* pixel = frame.row(y);
+			for(unsigned int x = 0; x < width_; ++x, pixel += 3){
+				luma_[std::size_t(y) * width_ + x] = static_cast<std::uint8_t>(((66 * pixel[0] + 129 * pixel[1] + 25 * pixel[2] + 128) >> 8) + 16);
+			}
+		}
+		// chroma of the mean of every 2x2 block of pixels, blocks on an odd edge being cut short
+		for(unsigned int cy = 0; cy < chroma_height; ++cy){
+			for(unsigned int cx = 0; cx < chroma_width; ++cx){
+				int r = 0;
+				int g = 0;
+				int b = 0;
+				int count = 0;
+				for(unsigned int y = 2 * cy; y < std::min(2 * cy + 2, height_); ++y){
+					for(unsigned int x = 2 * cx; x < std::min(2 * cx + 2, width_); ++x){
+						const std::uint8_t* pixel = frame.row(y) + 3 * x;
+						r += pixel[0];
+						g += pixel[1];
+						b += pixel[2];
+						++count;
+					}
+				}
+				r /= count;
+				g /= count;
+				b /= count;
+				cb_[std::size_t(cy) * chroma_width + cx] = static_cast<std::uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+				cr_[std::size_t(cy) * chroma_width + cx] = static_cast<std::uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+			}
+		}
+		file_ << "FRAME\n";
+		file_.write(reinterpret_cast<const char*>(luma_.data()), luma_.size());
+		file_.write(reinterpret_cast<const char*>(cb_.data()), cb_.size());
+		file_.write(reinterpret_cast<const char*>(cr_.data()), cr_.size());
+		if(!file_){
+			throw std::runtime_error("Could not write video file " + path_);
+		}
+	}
+
+	// Writes the frames still buffered.
+	// Throws std::runtime_error if they cannot be written.
+	void flush(){
+		if(!file_.flush()){
+			throw std::runtime_error("Could not write video file " + path_);
+		}
+	}
+
+private:
+	std::string path_;
+	std::ofstream file_;
+	unsigned int rate_numerator_;
+	unsigned int rate_denominator_;
+	unsigned int width_ = 0;
+	unsigned int height_ = 0;
+
+	// Planes of the frame being written, kept between frames
+	std::vector<std::uint8_t> luma_;
+	std::vector<std::uint8_t> cb_;
+	std::vector<std::uint8_t> cr_;
+};
+
+// Writes frames on a background thread so that encoding and writing them overlaps with simulating
+// and drawing the next ones. Frames are drawn into framebuffers taken from the exporter with
+// acquire() and handed back with submit(), so at most depth + 1 framebuffers are ever allocated
+// and no frame is copied. When the writer falls behind, acquire() waits for it.
+//
+// A path ending in .y4m is written as a single YUV4MPEG2 stream, any other path as a PNG file per
+// frame named after it with the frame number before the extension, eg: frames/run.png is written
+// as frames/run_000000.png, frames/run_000001.png...
+class FrameExporter {
+public:
+	// Starts writing to path frames played at rate_numerator / rate_denominator frames per second.
+	// Throws std::runtime_error if the video file cannot be opened.
+	FrameExporter(const std::string& path, unsigned int rate_numerator, unsigned int rate_denominator, std::size_t depth = 3) :
+		path_(path), depth_(std::max<std::size_t>(depth, 1))
+	{
+		if(path.size() >= 4 && path.compare(path.size() - 4, 4, ".y4m") == 0){
+			video_.emplace(path, rate_numerator, rate_denominator);
+		}
+		else {
+			std::size_t dot = path.find_last_of('.');
+			std::size_t slash = path.find_last_of('/');
+			if(dot == std::string::npos || (slash != std::string::npos && dot < slash)){
+				dot = path.size();
+			}
+			stem_ = path.substr(0, dot);
+			extension_ = path.substr(dot);
+		}
+		worker_ = std::thread([this]{ write_frames(); });
+	}
+
+	FrameExporter(const FrameExporter&) = delete;
+	FrameExporter& operator=(const FrameExporter&) = delete;
+
+	~FrameExporter(){
+		stop();
+	}
+
+	// Returns a framebuffer to draw the next frame into, waiting for one to be written if depth
+	// frames are already queued.
+	// Throws std::runtime_error if writing a previous frame failed.
+	Framebuffer acquire(){
+		std::unique_lock<std::mutex> lock(mutex_);
+		writable_.wait(lock, [this]{ return queue_.size() < depth_ || error_; });
+		rethrow();
+		if(free_.empty()){
+			return Framebuffer{};
+		}
+		Framebuffer frame = std::move(free_.back());
+		free_.pop_back();
+		return frame;
+	}
+
+	// Queues frame to be written after the frames submitted before it.
+	// Throws std::runtime_error if writing a previous frame failed.
+	void submit(Framebuffer&& frame){
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			rethrow();
+			queue_.push_back(std::move(frame));
+		}
+		queued_.notify_one();
+	}
+
+	// Waits for every submitted frame to be written and stops the writer.
+	// Throws std::runtime_error if writing a frame failed.
+	void finish(){
+		stop();
+		std::lock_guard<std::mutex> lock(mutex_);
+		rethrow();
+	}
+
+	// Returns the number of frames written so far.
+	std::size_t frames_written(){
+		std::lock_guard<std::mutex> lock(mutex_);
+		return written_;
+	}
+
+private:
+	void stop(){
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			done_ = true;
+		}
+		queued_.notify_one();
+		if(worker_.joinable()){
+			worker_.join();
+		}
+	}
+
+	// Must be called with mutex_ held.
+	void rethrow(){
+		if(error_){
+			std::rethrow_exception(error_);
+		}
+	}
+
+	// Writes the queued frames until stopped and the queue is empty, or until writing one fails.
+	void write_frames(){
+		std::unique_lock<std::mutex> lock(mutex_);
+		for(;;){
+			queued_.wait(lock, [this]{ return !queue_.empty() || done_; });
+			if(queue_.empty()){
+				break;
+			}
+			// the frame stays queued while written so acquire() counts it
+			Framebuffer& frame = queue_.front();
+			std::size_t index = written_;
+			lock.unlock();
+			std::exception_ptr error;
+			try {
+				PROFILE_SCOPE("write_frame");
+				if(video_){
+					video_->write(frame);
+				}
+				else {
+					char number[16];
+					std::snprintf(number, sizeof(number), "_%06zu", index);
+					write_png(stem_ + number + extension_, frame);
+				}
+			} catch(...){
+				error = std::current_exception();
+			}
+			lock.lock();
+			free_.push_back(std::move(queue_.front()));
+			queue_.pop_front();
+			if(error){
+				error_ = error;
+				queue_.clear();
+			}
+			else {
+				++written_;
+			}
+			writable_.notify_one();
+			if(error_){
+				break;
+			}
+		}
+		lock.unlock();
+		if(video_ && !error_){
+			try {
+				video_->flush();
+			} catch(...){
+				std::lock_guard<std::mutex> guard(mutex_);
+				error_ = std::current_exception();
+			}
+		}
+	}
+
+	std::string path_;
+	std::size_t depth_;
+	std::optional<Y4mWriter> video_;
+
+	// path of every PNG frame, without and after the frame number
+	std::string stem_;
+	std::string extension_;
+
+	std::mutex mutex_;
+	std::condition_variable queued_;
+	std::condition_variable writable_;
+	std::deque<Framebuffer> queue_;
+	std::vector<Framebuffer> free_;
+	std::size_t written_ = 0;
+	bool done_ = false;
+	std::exception_ptr error_;
+	std::thread worker_;
+};
+
+}
@@ -6,91 +6,298 @@
 #include <string>
 #include <exception>
 #include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <stdexcept>
 #include "ui_controller.hpp"
-#include <list>
+#include <optional>
 #include "earthquake_system.hpp"
+#include "simulation_pool.hpp"
+#include "snapshot.hpp"
+#include "event_log.hpp"
 
 
 namespace game {
     class GameStateController {
         using Particle = physics::Particle<float>;
         public:
-            static insertion_mode_t insertion_mode;
-            static Particle* prev_joint_particle;
-            static bool simulation_running;
-            static EarthquakeSystem<float> earthquake_system;
-            static UIController ui_controller;
-
-            // Create empty point manager and initialize an OpenGL window
-            GameStateController() {
+            // Created first so the window outlives everything drawn in it
+            UIController ui_controller;
+            insertion_mode_t insertion_mode = insertion_mode_t::PARTICLE;
+            std::optional<Particle> prev_joint_particle;
+            bool simulation_running = false;
+
+            // If set, every physics step advances the simulations by step_time in as many steps
+            // of their own timestep as they need (see EarthquakeSystem::advance)
+            bool adaptive_timestep = false;
+
+            // Simulations of the same building, stepped together on a pool of threads. Only the
+            // displayed one is drawn, the magnitude buttons only change the displayed one.
+            SimulationPool<float> simulations;
+            std::size_t displayed = 0;
+
+            // Part of the world shown in the window, panned with the arrow keys or by dragging with
+            // the right mouse button and zoomed with the mouse wheel or + and -
+            Camera camera;
+
+            // Create empty point managers and initialize an OpenGL window
+            // One simulation is created for each entry of magnitudes, or a single one with the
+            // default magnitudes if it is empty.
+            // If record_path is not empty, the session is recorded to an event log at that path.
+            // If replay_path is not empty, the session recorded in the event log at that path is
+            // replayed and user input other than closing the window is ignored.
+            // Sessions with several simulations can not be recorded or replayed.
+            // The world is world_width by world_height, or the size of the world of the replayed
+            // session, and is shown through the camera so it may be larger than the window.
+            GameStateController(const std::string& record_path = "", const std::string& replay_path = "",
+                                const std::vector<magnitudes_t>& magnitudes = {},
+                                unsigned int world_width = WIDTH, unsigned int world_height = HEIGHT)
+                : simulations(simulation_threads(magnitudes.size())),
+                  camera(WIDTH, HEIGHT, world_width, world_height) {
+                if (magnitudes.size() > 1 && (!record_path.empty() || !replay_path.empty())) {
+                    throw std::invalid_argument("Sessions with several simulations can not be recorded or replayed");
+                }
+                if (!replay_path.empty()) {
+                    replay.emplace(replay_path);
+                    const EventLogHeader& header = replay->header();
+                    if (header.ground_level != INIT_GROUND_LEVEL || header.step_time != step_time) {
+                        throw std::runtime_error("Event log " + replay_path + " was recorded in a different world");
+                    }
+                    world_width = header.width;
+                    world_height = header.height;
+                    camera = Camera(WIDTH, HEIGHT, world_width, world_height);
+                }
+
+                for (const magnitudes_t& magnitude : magnitudes) {
+                    simulations.add(world_width, world_height, INIT_GROUND_LEVEL).restore(0, 0, 0, magnitude.first, magnitude.second);
+                }
+                if (simulations.size() == 0) {
+                    simulations.add(world_width, world_height, INIT_GROUND_LEVEL);
+                }
+                if (replay) {
+                    simulations[0].restore(0, 0, 0, replay->header().magnitude_x, replay->header().magnitude_y);
+                    apply_event_log_settings(replay->header(), simulations[0].particle_system());
+                }
+                if (!record_path.empty()) {
+                    recorder.emplace(record_path, event_log_header(world_width, world_height, INIT_GROUND_LEVEL,
+                        simulations[0].magnitude_x(), simulations[0].magnitude_y(), step_time, simulations[0].particle_system()));
+                }
+
                 glfwSetErrorCallback(error_callback);
+                glfwSetWindowUserPointer(ui_controller.window, this);
                 glfwSetKeyCallback(ui_controller.window, key_callback);
                 glfwSetMouseButtonCallback(ui_controller.window, mouse_button_callback);
-
-                main_loop();
+                glfwSetCursorPosCallback(ui_controller.window, cursor_position_callback);
+                glfwSetScrollCallback(ui_controller.window, scroll_callback);
             }
             ~GameStateController() = default;
 
+            GameStateController(const GameStateController&) = delete;
+            GameStateController& operator=(const GameStateController&) = delete;
+
+            // The simulation drawn in the window
+            EarthquakeSystem<float>& earthquake_system() {
+                return simulations[displayed];
+            }
 
             static void error_callback(int error, const char* description) {
                 std::cout << "GLFW Error: " << description << std::endl;
             }
 
+            // GLFW callbacks are plain functions, they forward to the controller owning the window
             static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+                static_cast<GameStateController*>(glfwGetWindowUserPointer(window))->on_key(key, action);
+            }
+
+            static void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+                static_cast<GameStateController*>(glfwGetWindowUserPointer(window))->on_mouse_button(button, action);
+            }
+
+            static void cursor_position_callback(GLFWwindow* window, double xpos, double ypos) {
+                static_cast<GameStateController*>(glfwGetWindowUserPointer(window))->on_cursor_position(xpos, ypos);
+            }
+
+            static void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
+                static_cast<GameStateController*>(glfwGetWindowUserPointer(window))->on_scroll(yoffset);
+            }
+
+            void on_key(int key, int action) {
                 if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
                     glfwSetWindowShouldClose(ui_controller.window, GL_TRUE);
+
+                // Display the next simulation
+                if (key == GLFW_KEY_TAB && action == GLFW_PRESS && simulations.size() > 1) {
+                    displayed = (displayed + 1) % simulations.size();
+                    // The positions kept for interpolation belong to the previous simulation
+                    previous_x.clear();
+                    previous_y.clear();
+                }
+
+                // Zoom on the center of the window or go back to the initial view
+                if ((key == GLFW_KEY_EQUAL || key == GLFW_KEY_KP_ADD) && action != GLFW_RELEASE) {
+                    camera.zoom_at(WIDTH / 2.f, HEIGHT / 2.f, ZOOM_STEP);
+                }
+                if ((key == GLFW_KEY_MINUS || key == GLFW_KEY_KP_SUBTRACT) && action != GLFW_RELEASE) {
+                    camera.zoom_at(WIDTH / 2.f, HEIGHT / 2.f, 1 / ZOOM_STEP);
+                }
+                if (key == GLFW_KEY_HOME && action == GLFW_PRESS) {
+                    camera.reset();
+                }
+
+                // Show or hide the time spent in each phase of the last frame
+                if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+                    profiling::Profiler& profiler = profiling::Profiler::instance();
+                    ui_controller.show_profile = !ui_controller.show_profile;
+                    profiler.set_enabled(ui_controller.show_profile || profiler.has_outputs());
+                }
+
+                // Save the scene to or restore it from the snapshot file
+                if (key == GLFW_KEY_S && action == GLFW_PRESS) {
+                    try {
+                        save_snapshot(earthquake_system(), snapshot_file);
+                    } catch (std::exception& e) {
+                        std::cout << e.what() << std::endl;
+                    }
+                }
+                // Clear the scene to build another one, reusing the memory of the last
+                if (key == GLFW_KEY_R && action == GLFW_PRESS) {
+                    if (recorder || replay) {
+                        std::cout << "The scene can not be reset while recording or replaying" << std::endl;
+                        return;
+                    }
+                    simulations.reset();
+                    simulation_running = false;
+                    steps_run = 0;
+                    insertion_mode = insertion_mode_t::PARTICLE;
+                    prev_joint_particle = std::nullopt;
+                    previous_x.clear();
+                    previous_y.clear();
+                }
+                if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+                    if (recorder || replay) {
+                        std::cout << "Snapshots can not be loaded while recording or replaying" << std::endl;
+                        return;
+                    }
+                    // The record would carry on from where it was instead of from the time of the snapshot
+                    if (earthquake_system().ground_motion_source()) {
+                        std::cout << "Snapshots can not be loaded while the ground follows a record" << std::endl;
+                        return;
+                    }
+                    try {
+                        // Every simulation restores the scene but keeps its own magnitudes
+                        for (std::size_t i = 0; i < simulations.size(); ++i) {
+                            EarthquakeSystem<float>& system = simulations[i];
+                            unsigned int magnitude_x = system.magnitude_x();
+                            unsigned int magnitude_y = system.magnitude_y();
+                            load_snapshot(system, snapshot_file);
+                            if (simulations.size() > 1) {
+                                system.restore(system.run_time(), system.ground_dx(), system.ground_speed(), magnitude_x, magnitude_y);
+                            }
+                        }
+                        // Particles from before the load no longer exist
+                        insertion_mode = insertion_mode_t::PARTICLE;
+                        prev_joint_particle = std::nullopt;
+                        previous_x.clear();
+                        previous_y.clear();
+                    } catch (std::exception& e) {
+                        std::cout << e.what() << std::endl;
+                    }
+                }
             }
 
-            static void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+            // Drags the view while the right button is held
+            void on_cursor_position(double xpos, double ypos) {
+                if (dragging) {
+                    // Y starts from top, the camera's from bottom
+                    camera.pan(static_cast<float>(drag_x - xpos), static_cast<float>(ypos - drag_y));
+                }
+                drag_x = xpos;
+                drag_y = ypos;
+            }
+
+            // Zooms on the point under the cursor
+            void on_scroll(double offset) {
+                double xpos, ypos;
+                glfwGetCursorPos(ui_controller.window, &xpos, &ypos);
+                camera.zoom_at(static_cast<float>(xpos), static_cast<float>(HEIGHT - ypos), static_cast<float>(std::pow(ZOOM_STEP, offset)));
+            }
+
+            void on_mouse_button(int button, int action) {
+                // The view can be moved while replaying too
+                if (button == GLFW_MOUSE_BUTTON_RIGHT) {
+                    dragging = action == GLFW_PRESS;
+                    glfwGetCursorPos(ui_controller.window, &drag_x, &drag_y);
+                }
+
+                // The replayed session is the only source of input
+                if (replay) {
+                    return;
+                }
+
                 if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
                     // Get cursor position
                     double xpos, ypos;
                     glfwGetCursorPos(ui_controller.window, &xpos, &ypos);
-                    int x = (int)xpos;
-                    int y = HEIGHT - (int)ypos; // Y starts from top, we want it from bottom
+                    ypos = HEIGHT - ypos; // Y starts from top, we want it from bottom
 
-                    Point pos(x, y);
+                    // The buttons are in window coordinates
+                    Point pos(static_cast<int>(xpos), static_cast<int>(ypos));
+
+                    // The rest is in world coordinates
+                    int x = static_cast<int>(std::floor(camera.to_world_x(static_cast<float>(xpos))));
+                    int y = static_cast<int>(std::floor(camera.to_world_y(static_cast<float>(ypos))));
 
                     // Check if we're over a button
                     if (ui_controller.start_bbox.has_on_bounded_side(pos)) {
                         // Start simulation
-                        simulation_running = true;
+                        handle_event(EventType::START);
                     } else if (ui_controller.stop_bbox.has_on_bounded_side(pos)) {
                         // Stop simulation
-                        simulation_running = false;
-                        insertion_mode = insertion_mode_t::PARTICLE;
+                        handle_event(EventType::STOP);
                     }
                     // Over horizontal magnitude up
                     else if (ui_controller.horizontal_mag_up_bbox.has_on_bounded_side(pos)) {
-                        earthquake_system.inc_magnitude_x(1);
+                        handle_event(EventType::MAGNITUDE_X, 1);
                     }
                     // Over horizontal magnitude down
                     else if (ui_controller.horizontal_mag_down_bbox.has_on_bounded_side(pos)) {
-                        earthquake_system.inc_magnitude_x(-1);
+                        handle_event(EventType::MAGNITUDE_X, -1);
                     }
                     // Over vertical magnitude up
                     else if (ui_controller.vertical_mag_up_bbox.has_on_bounded_side(pos)) {
-                        earthquake_system.inc_magnitude_y(1);
+                        handle_event(EventType::MAGNITUDE_Y, 1);
                     }
                     // Over vertical magnitude down
                     else if (ui_controller.vertical_mag_down_bbox.has_on_bounded_side(pos)) {
-                        earthquake_system.inc_magnitude_y(-1);
+                        handle_event(EventType::MAGNITUDE_Y, -1);
                     }
                     else if (!simulation_running) {
                         // Insertion mode
-                        Particle* p = earthquake_system.particle_near(x, y, 10);
+                        // Particles are picked within 10 pixels whatever the zoom
+                        std::optional<Particle> p = earthquake_system().particle_near(x, y, 10 / camera.zoom());
 
-                        // Snap to the nearest 20x20 grid point from the ground up
-                        int y_snap = static_cast<int>(earthquake_system.ground_height()) - INIT_GROUND_LEVEL;
-                        if(x % 20 < 10)             x -= x % 20;
-                        else                        x += 20 - x % 20;
-                        if((y - y_snap) % 20 < 10)  y -= (y - y_snap) % 20;
-                        else                        y += 20 - (y - y_snap) % 20;
+                        // Snap to the nearest grid point from the ground up
+                        constexpr int grid = EarthquakeSystem<float>::GRID_SIZE;
+                        int y_snap = static_cast<int>(earthquake_system().ground_height()) - INIT_GROUND_LEVEL;
+                        if(x % grid < grid / 2)             x -= x % grid;
+                        else                                x += grid - x % grid;
+                        if((y - y_snap) % grid < grid / 2)  y -= (y - y_snap) % grid;
+                        else                                y += grid - (y - y_snap) % grid;
 
                         switch(insertion_mode){
                             case insertion_mode_t::PARTICLE:
                                 if (!p) {
-                                    prev_joint_particle = &earthquake_system.create_particle(x, y);
+                                    // Every simulation holds the same building, particles are
+                                    // created at the same index in each of them
+                                    for (std::size_t i = 0; i < simulations.size(); ++i) {
+                                        Particle created = simulations[i].create_particle(x, y);
+                                        if (i == displayed) {
+                                            prev_joint_particle = created;
+                                        }
+                                    }
+                                    record_event(Event{steps_run, EventType::CREATE_PARTICLE, 0, static_cast<float>(x), static_cast<float>(y), 0, 0});
                                 }
                                 // We selected an existing particle, enter joint mode
                                 else {
@@ -100,13 +307,13 @@ namespace game {
                                 break;
                             case insertion_mode_t::JOINT:
                                 if (p) {
-                                    earthquake_system.create_joint(prev_joint_particle->x(), prev_joint_particle->y(), p->x(), p->y());
+                                    handle_event(EventType::CREATE_JOINT, 0, prev_joint_particle->x(), prev_joint_particle->y(), p->x(), p->y());
                                 }
                                 else {
-                                    earthquake_system.create_joint(prev_joint_particle->x(), prev_joint_particle->y(), x, y);
+                                    handle_event(EventType::CREATE_JOINT, 0, prev_joint_particle->x(), prev_joint_particle->y(), x, y);
                                 }
                                 insertion_mode = insertion_mode_t::PARTICLE;
-                                prev_joint_particle = nullptr;
+                                prev_joint_particle = std::nullopt;
                                 break;
                             default:
                                 throw std::runtime_error("Unknown insertion mode");
@@ -118,65 +325,209 @@ namespace game {
                 }
                     
             }
-            
+
+            // Runs the session until the window is closed
+            void run() {
+                main_loop();
+            }
+
         private:
-            constexpr static long update_rate = 1000 / FPS;
+            // File the scene is saved to with S and restored from with L
+            constexpr static const char* snapshot_file = "earthquake.snapshot";
+
+            // Zoom factor of a step of the mouse wheel or a press of + or -
+            constexpr static float ZOOM_STEP = 1.25f;
+
+            // Speed the arrow keys pan the view at, in pixels per second
+            constexpr static double PAN_SPEED = 600;
+
+            // True while the view is dragged, and the cursor position the drag last moved it from
+            bool dragging = false;
+            double drag_x = 0;
+            double drag_y = 0;
+
+            // Wall clock duration of a physics step
+            constexpr static double step_duration = 1.0 / PHYSICS_RATE;
+
+            // Simulated time of a physics step. The simulation was tuned for TIMESTEP at 60 steps
+            // per second, so the step is scaled to keep the simulation running at the same speed
+            // whatever the physics rate.
+            constexpr static double step_time = EarthquakeSystem<float>::TIMESTEP * 60.0 / PHYSICS_RATE;
+
+            // Positions of the particles of the displayed simulation before the last physics step,
+            // for interpolation
+            std::vector<float> previous_x;
+            std::vector<float> previous_y;
 
-            // Calls update_game_state every 1/FPS seconds
-            // Calls render as often as possible
+            // Number of physics steps run since the start of the session, events are stamped with it
+            unsigned long steps_run = 0;
+
+            // Log the session is recorded to, if any
+            std::optional<EventRecorder> recorder;
+
+            // Log of the session being replayed, if any
+            std::optional<EventReader> replay;
+
+            // Number of threads stepping the given number of simulations
+            static unsigned int simulation_threads(std::size_t simulations) {
+                unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+                return static_cast<unsigned int>(std::clamp<std::size_t>(simulations, 1, cores));
+            }
+
+            // Applies an event of the session and records it. Magnitude changes only apply to the
+            // displayed simulation, everything else to all of them.
+            void handle_event(EventType type, int delta = 0, float x1 = 0, float y1 = 0, float x2 = 0, float y2 = 0) {
+                Event event{steps_run, type, delta, x1, y1, x2, y2};
+                switch (type) {
+                    case EventType::START:
+                        simulation_running = true;
+                        break;
+                    case EventType::STOP:
+                        simulation_running = false;
+                        insertion_mode = insertion_mode_t::PARTICLE;
+                        break;
+                    case EventType::MAGNITUDE_X:
+                    case EventType::MAGNITUDE_Y:
+                        apply_event(earthquake_system(), event);
+                        break;
+                    default:
+                        for (std::size_t i = 0; i < simulations.size(); ++i) {
+                            apply_event(simulations[i], event);
+                        }
+                        break;
+                }
+                record_event(event);
+            }
+
+            // Records an event of the session if it is being recorded
+            void record_event(const Event& event) {
+                if (recorder) {
+                    recorder->record(event);
+                }
+            }
+
+            // Applies the events of the replayed session that happened before the next step
+            void replay_events() {
+                if (!replay) {
+                    return;
+                }
+                while (const Event* event = replay->peek()) {
+                    if (event->step > steps_run) {
+                        break;
+                    }
+                    if (event->type == EventType::END) {
+                        simulation_running = false;
+                    }
+                    else {
+                        handle_event(event->type, event->delta, event->x1, event->y1, event->x2, event->y2);
+                    }
+                    replay->pop();
+                }
+            }
+
+            // Runs as many fixed physics steps as the elapsed time requires (at most
+            // MAX_STEPS_PER_FRAME per frame, the rest of the time is dropped when the simulation
+            // can not keep up) then renders as often as possible, drawing the particles part way
+            // between the last two physics steps according to the time left over.
             void main_loop() {
-                auto start_time = std::chrono::high_resolution_clock::now();
-                auto a = start_time;
-                auto time_running = start_time;
+                auto previous_time = std::chrono::steady_clock::now();
+                double accumulator = 0;
 
                 while (!ui_controller.shouldClose()) {
-                    auto b = std::chrono::high_resolution_clock::now();
-                    auto delta_time = std::chrono::duration_cast<std::chrono::milliseconds>(b - a).count();
-                    if(delta_time >= update_rate) {
-                        a = b;
+                    replay_events();
+
+                    auto now = std::chrono::steady_clock::now();
+                    double elapsed = std::chrono::duration<double>(now - previous_time).count();
+                    accumulator += elapsed;
+                    previous_time = now;
+                    pan_with_keys(elapsed);
+
+                    // Time does not build up while paused
+                    if (!simulation_running) {
+                        accumulator = 0;
+                    }
+
+                    int steps = std::min(static_cast<int>(accumulator / step_duration), MAX_STEPS_PER_FRAME);
+                    for (int i = 0; i < steps; ++i) {
+                        if (i == steps - 1) {
+                            auto xs = earthquake_system().particle_system().xs();
+                            auto ys = earthquake_system().particle_system().ys();
+                            previous_x.assign(xs.begin(), xs.end());
+                            previous_y.assign(ys.begin(), ys.end());
+                        }
+                        replay_events();
                         update_game_state();
                     }
-                    // If simulation is running tick the timer
-                    if (simulation_running) {
-                        time_running += std::chrono::milliseconds(delta_time);
+                    accumulator -= steps * step_duration;
+                    // Avoid the spiral of death
+                    if (accumulator >= step_duration) {
+                        accumulator = std::fmod(accumulator, step_duration);
                     }
+
                     // If simulation state goes from stopped to running, invalidate the selected joint particle
                     if (prev_joint_particle && simulation_running) {
-                        prev_joint_particle = nullptr;
+                        prev_joint_particle = std::nullopt;
                     }
 
-                    ui_controller.render(earthquake_system.particles(), 
-                                         earthquake_system.joints(), 
+                    // Interpolate only while running, particles are drawn where they are otherwise
+                    interpolation_t interpolation{previous_x, previous_y, simulation_running ? static_cast<float>(accumulator / step_duration) : 1.f};
+
+                    EarthquakeSystem<float>& shown = earthquake_system();
+                    ui_controller.render(shown.particle_system(),
+                                         camera,
+                                         interpolation,
                                          simulation_running, // Simulation state
                                          insertion_mode,
-                                         insertion_mode == insertion_mode_t::JOINT ? prev_joint_particle : nullptr, // Selected Joint
-                                         earthquake_system.magnitude_x(), // Horizontal shake
-                                         earthquake_system.magnitude_y(), // Vertical shake
-                                         earthquake_system.ground_height(), // Ground height
-                                         earthquake_system.ground_dx(), // Ground dx
-                                         std::string("Time: ") + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(time_running - start_time).count() / 1000) + "s" // Timer string
+                                         insertion_mode == insertion_mode_t::JOINT ? prev_joint_particle : std::nullopt, // Selected Joint
+                                         shown.magnitude_x(), // Horizontal shake
+                                         shown.magnitude_y(), // Vertical shake
+                                         shown.ground_height(), // Ground height
+                                         shown.ground_dx(), // Ground dx
+                                         std::string("Time: ") + std::to_string(static_cast<long>(steps_run * step_duration)) + "s" // Timer string
                                          ); 
 
                     glfwPollEvents();
-                    
+
+                    profiling::Profiler& profiler = profiling::Profiler::instance();
+                    if (profiler.enabled()) {
+                        profiler.end_frame();
+                    }
+                }
+
+                if (recorder) {
+                    recorder->record(steps_run, EventType::END);
                 }
             }
         
-            // Called every 1/FPS seconds
-            static void update_game_state(){
+            // Pans the view along the arrow keys held for the given number of seconds
+            void pan_with_keys(double seconds) {
+                GLFWwindow* window = ui_controller.window;
+                float distance = static_cast<float>(PAN_SPEED * std::min(seconds, 0.1));
+                float dx = 0;
+                float dy = 0;
+                if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)  dx -= distance;
+                if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) dx += distance;
+                if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)  dy -= distance;
+                if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)    dy += distance;
+                if (dx != 0 || dy != 0) {
+                    camera.pan(dx, dy);
+                }
+            }
+
+            // Called once per physics step
+            void update_game_state(){
                 // Update particles and joints
                 // Calculates physics only when the simulation is running
                 if (simulation_running) {
-                    earthquake_system.update();
+                    if (adaptive_timestep) {
+                        simulations.advance(step_time);
+                    }
+                    else {
+                        simulations.update(step_time);
+                    }
+                    ++steps_run;
                 }
             }
 
         };
-
-    insertion_mode_t GameStateController::insertion_mode = insertion_mode_t::PARTICLE;
-    physics::Particle<float>* GameStateController::prev_joint_particle = nullptr;
-    bool GameStateController::simulation_running = false;
-    UIController GameStateController::ui_controller = UIController();
-    FontController UIController::font_controller = FontController();
-    EarthquakeSystem<float> GameStateController::earthquake_system = EarthquakeSystem<float>(WIDTH, HEIGHT, INIT_GROUND_LEVEL);
-}
\ No newline at end of file
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+namespace physics {
+
+// A 2D vector or point of plain values. Unlike a CGAL kernel object it holds no handle, so it is
+// as cheap to copy and compute with as its two coordinates and is usable in constant expressions.
+template <class T> struct Vector2 {
+	T x_;
+	T y_;
+
+	constexpr Vector2() : x_(0), y_(0) {}
+	constexpr Vector2(T x, T y) : x_(x), y_(y) {}
+
+	constexpr T x() const {
+		return x_;
+	}
+
+	constexpr T y() const {
+		return y_;
+	}
+
+	constexpr Vector2 operator+(const Vector2& other) const {
+		return Vector2(x_ + other.x_, y_ + other.y_);
+	}
+
+	constexpr Vector2 operator-(const Vector2& other) const {
+		return Vector2(x_ - other.x_, y_ - other.y_);
+	}
+
+	constexpr Vector2 operator*(T scale) const {
+		return Vector2(x_ * scale, y_ * scale);
+	}
+
+	constexpr Vector2& operator+=(const Vector2& other){
+		x_ += other.x_;
+		y_ += other.y_;
+		return *this;
+	}
+
+	constexpr Vector2& operator-=(const Vector2& other){
+		x_ -= other.x_;
+		y_ -= other.y_;
+		return *this;
+	}
+
+	// Returns the dot product of the two vectors.
+	constexpr T operator*(const Vector2& other) const {
+		return x_ * other.x_ + y_ * other.y_;
+	}
+
+	// Returns the squared length of the vector.
+	constexpr T squared_length() const {
+		return x_ * x_ + y_ * y_;
+	}
+
+	constexpr bool operator==(const Vector2& other) const = default;
+};
+
+// An axis aligned box given by its lower left and upper right corners, with the accessors of
+// CGAL::Iso_rectangle_2 the physics code used.
+template <class T> struct Box2 {
+	Vector2<T> min_;
+	Vector2<T> max_;
+
+	constexpr Box2() = default;
+	constexpr Box2(const Vector2<T>& min, const Vector2<T>& max) : min_(min), max_(max) {}
+
+	constexpr const Vector2<T>& min() const {
+		return min_;
+	}
+
+	constexpr const Vector2<T>& max() const {
+		return max_;
+	}
+
+	constexpr T xmin() const {
+		return min_.x();
+	}
+
+	constexpr T ymin() const {
+		return min_.y();
+	}
+
+	constexpr T xmax() const {
+		return max_.x();
+	}
+
+	constexpr T ymax() const {
+		return max_.y();
+	}
+
+	// Returns true if the point is inside the box or on its boundary.
+	constexpr bool contains(const Vector2<T>& point) const {
+		return point.x() >= min_.x() && point.x() <= max_.x() && point.y() >= min_.y() && point.y() <= max_.y();
+	}
+
+	constexpr bool operator==(const Box2& other) const = default;
+};
+
+}
@@ -0,0 +1,439 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace game {
+
+// Source of the motion of the ground of an EarthquakeSystem, see EarthquakeSystem::set_ground_motion.
+class GroundMotion {
+public:
+	virtual ~GroundMotion() = default;
+
+	// Returns the horizontal and vertical distance the ground moves by during the next step of dt.
+	virtual std::pair<double, double> advance(double dt) = 0;
+
+	// Goes back to the start of the motion, so that it is played again from the first step.
+	virtual void rewind() = 0;
+};
+
+// Ground acceleration of both channels of a record at a point in time, in the unit of the record.
+struct AccelerogramSample {
+	double time;
+	double horizontal;
+	double vertical;
+};
+
+// Reads the samples of a ground acceleration record (an accelerogram) from the start, a few at a
+// time, so records of any length can be played without loading them.
+class AccelerogramReader {
+public:
+	virtual ~AccelerogramReader() = default;
+
+	// Reads up to max of the next samples into samples and returns the number read, 0 once the
+	// record has been read entirely.
+	// Throws std::runtime_error if the record is malformed.
+	virtual std::size_t read(AccelerogramSample* samples, std::size_t max) = 0;
+
+	// Goes back to the start of the record, the next read returns its first samples.
+	// Throws std::runtime_error if the record can not be read again.
+	virtual void rewind() = 0;
+};
+
+// Reads an accelerogram from a text file with one sample per line: its time in seconds, then its
+// horizontal and, optionally, vertical acceleration, separated by commas. Empty lines, lines
+// starting with # and a header line before the first sample are skipped.
+class CsvAccelerogramReader : public AccelerogramReader {
+public:
+	// bytes of the file read at once
+	static constexpr std::size_t CHUNK_BYTES = 1 << 16;
+
+	// Opens the file at path.
+	// Throws std::runtime_error if the file can not be read.
+	explicit CsvAccelerogramReader(const std::string& path) :
+		path_(path),
+		file_(path, std::ios::binary),
+		begin_(0),
+		line_(0),
+		eof_(false),
+		header_skipped_(false),
+		seen_sample_(false)
+	{
+		if(!file_){
+			throw std::runtime_error("Could not read accelerogram " + path);
+		}
+	}
+
+	std::size_t read(AccelerogramSample* samples, std::size_t max) override {
+		std::size_t count = 0;
+		std::string_view line;
+		while(count < max && next_line(line)){
+			if(parse(line, samples[count])){
+				seen_sample_ = true;
+				++count;
+			}
+		}
+		return count;
+	}
+
+	void rewind() override {
+		file_.clear();
+		if(!file_.seekg(0)){
+			throw std::runtime_error("Could not read accelerogram " + path_);
+		}
+		buffer_.clear();
+		begin_ = 0;
+		line_ = 0;
+		eof_ = false;
+		header_skipped_ = false;
+		seen_sample_ = false;
+	}
+
+private:
+	// Sets line to the next line of the file, reading the file a chunk at a time. The line is only
+	// valid until the next call. Returns false at the end of the file.
+	bool next_line(std::string_view& line){
+		while(true){
+			std::size_t end = buffer_.find('\n', begin_);
+			if(end != std::string::npos || (eof_ && begin_ < buffer_.size())){
+				if(end == std::string::npos){
+					end = buffer_.size();
+				}
+				line = std::string_view(buffer_).substr(begin_, end - begin_);
+				begin_ = end + 1;
+				++line_;
+				return true;
+			}
+			if(eof_){
+				return false;
+			}
+
+			// keep the start of the line cut by the end of the last chunk
+			buffer_.erase(0, begin_);
+			begin_ = 0;
+			std::size_t size = buffer_.size();
+			buffer_.resize(size + CHUNK_BYTES);
+			file_.read(&buffer_[size], CHUNK_BYTES);
+			buffer_.resize(size + file_.gcount());
+			if(file_.bad()){
+				throw std::runtime_error("Could not read accelerogram " + path_);
+			}
+			eof_ = !file_;
+		}
+	}
+
+	// Parses a line into sample. Returns false if the line holds no sample.
+	// Throws std::runtime_error if the line is malformed.
+	bool parse(std::string_view line, AccelerogramSample& sample){
+		// copied so strtod stops at the end of the line
+		scratch_.assign(line);
+		if(!scratch_.empty() && scratch_.back() == '\r'){
+			scratch_.pop_back();
+		}
+		std::size_t first = scratch_.find_first_not_of(" \t");
+		if(first == std::string::npos || scratch_[first] == '#'){
+			return false;
+		}
+
+		double values[3] = {0, 0, 0};
+		int count = 0;
+		bool valid = true;
+		const char* field = scratch_.c_str();
+		while(valid){
+			char* end = nullptr;
+			double value = std::strtod(field, &end);
+			if(end == field || count == 3){
+				valid = false;
+				break;
+			}
+			values[count++] = value;
+			while(*end == ' ' || *end == '\t'){
+				++end;
+			}
+			if(*end == '\0'){
+				break;
+			}
+			valid = *end == ',';
+			field = end + 1;
+		}
+
+		if(!valid || count < 2){
+			if(!seen_sample_ && !header_skipped_){
+				header_skipped_ = true;
+				return false;
+			}
+			throw std::runtime_error("Malformed line " + std::to_string(line_) + " of accelerogram " + path_);
+		}
+		sample = AccelerogramSample{values[0], values[1], values[2]};
+		return true;
+	}
+
+	std::string path_;
+	std::ifstream file_;
+
+	// chunks of the file not parsed yet, from begin_
+	std::string buffer_;
+	std::size_t begin_;
+
+	// number of the last line read
+	unsigned long line_;
+	bool eof_;
+	bool header_skipped_;
+	bool seen_sample_;
+
+	// the line being parsed, kept to reuse its memory
+	std::string scratch_;
+};
+
+// Header at the start of a binary accelerogram. It is followed by sample_count samples taken
+// sample_rate times per second from start_time, each stored as channels 32 bit floats (horizontal
+// then vertical acceleration) in the byte order of the machine that wrote it.
+struct AccelerogramHeader {
+	char magic[4];
+	std::uint32_t version;
+	std::uint32_t channels;
+	std::uint32_t reserved;
+	double sample_rate;
+	double start_time;
+	std::uint64_t sample_count;
+};
+static_assert(sizeof(AccelerogramHeader) == 40, "AccelerogramHeader must match the file layout");
+
+constexpr char ACCELEROGRAM_MAGIC[4] = {'E', 'Q', 'A', 'G'};
+constexpr std::uint32_t ACCELEROGRAM_VERSION = 1;
+
+// Reads a binary accelerogram, see AccelerogramHeader.
+class BinaryAccelerogramReader : public AccelerogramReader {
+public:
+	// Opens the file at path and reads its header.
+	// Throws std::runtime_error if the file can not be read or is not a binary accelerogram.
+	explicit BinaryAccelerogramReader(const std::string& path) :
+		path_(path),
+		file_(path, std::ios::binary),
+		next_(0)
+	{
+		if(!file_.read(reinterpret_cast<char*>(&header_), sizeof(header_))){
+			throw std::runtime_error("Could not read accelerogram " + path);
+		}
+		if(std::memcmp(header_.magic, ACCELEROGRAM_MAGIC, sizeof(ACCELEROGRAM_MAGIC)) != 0){
+			throw std::runtime_error("Not a binary accelerogram " + path);
+		}
+		if(header_.version != ACCELEROGRAM_VERSION){
+			throw std::runtime_error("Unsupported accelerogram version " + path);
+		}
+		if((header_.channels != 1 && header_.channels != 2) || !(header_.sample_rate > 0)){
+			throw std::runtime_error("Invalid accelerogram header " + path);
+		}
+	}
+
+	const AccelerogramHeader& header() const {
+		return header_;
+	}
+
+	std::size_t read(AccelerogramSample* samples, std::size_t max) override {
+		std::size_t count = static_cast<std::size_t>(std::min<std::uint64_t>(max, header_.sample_count - next_));
+		values_.resize(count * header_.channels);
+		if(!file_.read(reinterpret_cast<char*>(values_.data()), values_.size() * sizeof(float))){
+			throw std::runtime_error("Truncated accelerogram " + path_);
+		}
+		for(std::size_t i = 0; i < count; ++i){
+			const float* value = &values_[i * header_.channels];
+			samples[i] = AccelerogramSample{
+				header_.start_time + (next_ + i) / header_.sample_rate,
+				value[0],
+				header_.channels > 1 ? value[1] : 0.0
+			};
+		}
+		next_ += count;
+		return count;
+	}
+
+	void rewind() override {
+		file_.clear();
+		if(!file_.seekg(sizeof(header_))){
+			throw std::runtime_error("Could not read accelerogram " + path_);
+		}
+		next_ = 0;
+	}
+
+private:
+	std::string path_;
+	std::ifstream file_;
+	AccelerogramHeader header_;
+
+	// index of the next sample to read
+	std::uint64_t next_;
+
+	// the values of the last chunk read, kept to reuse their memory
+	std::vector<float> values_;
+};
+
+// Opens the accelerogram at path, binary if it starts with ACCELEROGRAM_MAGIC and CSV otherwise.
+// Throws std::runtime_error if the file can not be read or is not an accelerogram.
+inline std::unique_ptr<AccelerogramReader> open_accelerogram(const std::string& path){
+	char magic[sizeof(ACCELEROGRAM_MAGIC)] = {};
+	{
+		std::ifstream file(path, std::ios::binary);
+		if(!file){
+			throw std::runtime_error("Could not read accelerogram " + path);
+		}
+		file.read(magic, sizeof(magic));
+	}
+	if(std::memcmp(magic, ACCELEROGRAM_MAGIC, sizeof(ACCELEROGRAM_MAGIC)) == 0){
+		return std::make_unique<BinaryAccelerogramReader>(path);
+	}
+	return std::make_unique<CsvAccelerogramReader>(path);
+}
+
+// Moves the ground as recorded by an accelerogram, from the start of the record when it is first
+// advanced. The record is streamed in chunks of CHUNK_SAMPLES samples and resampled to the steps
+// of the simulation: the acceleration is taken to be linear between samples (and zero outside
+// of the record) and integrated exactly over each step, so no sample is skipped whatever the
+// length of the steps. The velocity of the ground is then integrated with the trapezoidal rule.
+// Records are expected to be baseline corrected, any residual velocity keeps the ground drifting.
+class AccelerogramMotion : public GroundMotion {
+public:
+	// number of samples read from the record at once
+	static constexpr std::size_t CHUNK_SAMPLES = 4096;
+
+	// Plays the record read by reader. Accelerations in the simulation are gain times the ones
+	// recorded, gravity being 1: a gain of 1 plays a record in units of g to scale.
+	explicit AccelerogramMotion(std::unique_ptr<AccelerogramReader> reader, double gain = 1) :
+		reader_(std::move(reader)),
+		gain_(gain),
+		chunk_(CHUNK_SAMPLES),
+		chunk_size_(0),
+		next_(0),
+		begin_{0, 0, 0},
+		end_{0, 0, 0},
+		has_begin_(false),
+		has_end_(false),
+		started_(false),
+		time_(0),
+		velocity_x_(0),
+		velocity_y_(0)
+	{}
+
+	// Throws std::runtime_error if the record is malformed.
+	std::pair<double, double> advance(double dt) override {
+		auto [ax, ay] = integrate(time_, time_ + dt);
+		time_ += dt;
+		double vx = velocity_x_ + gain_ * ax;
+		double vy = velocity_y_ + gain_ * ay;
+		std::pair<double, double> motion((velocity_x_ + vx) / 2 * dt, (velocity_y_ + vy) / 2 * dt);
+		velocity_x_ = vx;
+		velocity_y_ = vy;
+		return motion;
+	}
+
+	// Throws std::runtime_error if the record can not be read again.
+	void rewind() override {
+		reader_->rewind();
+		chunk_size_ = 0;
+		next_ = 0;
+		begin_ = AccelerogramSample{0, 0, 0};
+		end_ = AccelerogramSample{0, 0, 0};
+		has_begin_ = false;
+		has_end_ = false;
+		started_ = false;
+		time_ = 0;
+		velocity_x_ = 0;
+		velocity_y_ = 0;
+	}
+
+	// Returns true once every sample of the record has been played.
+	bool finished() const {
+		return started_ && !has_end_;
+	}
+
+	// Returns the time played since the start of the record.
+	double time() const {
+		return time_;
+	}
+
+private:
+	// Returns the integral of the acceleration of both channels over [t0, t1].
+	std::pair<double, double> integrate(double t0, double t1){
+		if(!started_){
+			started_ = true;
+			has_end_ = fetch(end_);
+		}
+
+		double ax = 0;
+		double ay = 0;
+		double t = t0;
+		while(t < t1 && has_end_){
+			// move on to the segment between two samples containing t
+			if(end_.time <= t){
+				begin_ = end_;
+				has_begin_ = true;
+				has_end_ = fetch(end_);
+				continue;
+			}
+			double u = std::min(t1, end_.time);
+			// before the first sample the ground is still
+			if(has_begin_){
+				double span = end_.time - begin_.time;
+				double w0 = (t - begin_.time) / span;
+				double w1 = (u - begin_.time) / span;
+				double x0 = begin_.horizontal + w0 * (end_.horizontal - begin_.horizontal);
+				double x1 = begin_.horizontal + w1 * (end_.horizontal - begin_.horizontal);
+				double y0 = begin_.vertical + w0 * (end_.vertical - begin_.vertical);
+				double y1 = begin_.vertical + w1 * (end_.vertical - begin_.vertical);
+				ax += (x0 + x1) / 2 * (u - t);
+				ay += (y0 + y1) / 2 * (u - t);
+			}
+			t = u;
+		}
+		return {ax, ay};
+	}
+
+	// Reads the next sample of the record into sample, the next chunk first if the current one has
+	// been used up. Returns false at the end of the record.
+	// Throws std::runtime_error if the sample is earlier than the previous one.
+	bool fetch(AccelerogramSample& sample){
+		if(next_ == chunk_size_){
+			chunk_size_ = reader_->read(chunk_.data(), chunk_.size());
+			next_ = 0;
+			if(chunk_size_ == 0){
+				return false;
+			}
+		}
+		double previous = sample.time;
+		sample = chunk_[next_++];
+		if(has_begin_ && sample.time < previous){
+			throw std::runtime_error("Accelerogram samples must be in chronological order");
+		}
+		return true;
+	}
+
+	std::unique_ptr<AccelerogramReader> reader_;
+	double gain_;
+
+	// the last chunk read and the index of its next sample
+	std::vector<AccelerogramSample> chunk_;
+	std::size_t chunk_size_;
+	std::size_t next_;
+
+	// the samples before and after the current time, if any
+	AccelerogramSample begin_;
+	AccelerogramSample end_;
+	bool has_begin_;
+	bool has_end_;
+	bool started_;
+
+	double time_;
+	double velocity_x_;
+	double velocity_y_;
+};
+
+}
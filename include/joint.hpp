@@ -1,81 +1,103 @@
 #pragma once
 
 #include <cmath>
+#include <cstdint>
 
 #include "particle.hpp"
 
 namespace physics {
 
+// Identifies a joint stored in a ParticleSystem. See ParticleHandle.
+struct JointHandle {
+	std::uint32_t index;
+	std::uint32_t generation;
+
+	bool operator==(const JointHandle& other) const = default;
+};
+
+// The data of a joint as stored by a ParticleSystem: the indices of the two particles it connects
+// and the length it maintains between them.
+template <class T> struct JointConstraint {
+	std::uint32_t p1;
+	std::uint32_t p2;
+	T length;
+};
+
 // Represents a Joint between two particles who's length is fixed.
+// Like Particle, a Joint is a view of the joint stored in its ParticleSystem. A joint never owns
+// a particle as many joints may be connected to the same particle, it only refers to their indices.
 template <class T> class Joint {
 public:
-	// The particle type used by the joint. Its important that its a reference type as a 
-	// joint never owns a particle as many joints may be connected to the same particle.
-	using ParticleType = Particle<T>&;
 	using Point = typename Particle<T>::Point;
 	using Vector = typename Particle<T>::Vector;
 
-	// Constructs a joint between the given particles. The length of the joint is set to
-	// the distance between the two particles at the time of creation.
-	Joint(ParticleType p1, ParticleType p2) : p1_(p1), p2_(p2){
-		if(p1 == p2) {
-			throw std::invalid_argument("Joint cannot be created between a particle and itself.");
-		}
-		length_ = std::sqrt((p1.pos_ - p2.pos_).squared_length());
-	}
+	// Constructs a view of the joint identified by handle in the given system.
+	Joint(ParticleSystem<T>& system, JointHandle handle) :
+		system_(&system),
+		handle_(handle)
+	{}
 
-	void operator=(const Joint& other) {
-		p1_ = other.p1_;
-		p2_ = other.p2_;
-		length_ = other.length_;
+	bool operator==(const Joint& other) const {
+		return system_ == other.system_ && handle_ == other.handle_;
 	}
 
-	bool operator==(const Joint& other) const {
-		return (p1_ == other.p1_ && p2_ == other.p2_) || (p1_ == other.p2_ && p2_ == other.p1_);
+	// Returns true if the joint still exists in its system.
+	bool valid() const {
+		return system_->valid(handle_);
 	}
-	
+
 	// Maintains the length of the joint by moving the two particles closer or farther apart
 	// depending on the current distance between them. Depending on the number of joints
 	// connected to p1 and p2, multiple iterations of this function may be necessary.
-	void maintain_length(){
-		// computes the current distance between the two particles
-		Vector delta = p2_.pos_ - p1_.pos_;
-		T distance = std::sqrt(delta.squared_length());
-		T diff = (distance - length_) / distance;
-
-		// updates the position of the particles
-		if(p1_.fixed() && !p2_.fixed()){
-			p2_.pos_ -= delta * diff;
-		}
-		else if(p2_.fixed() && !p1_.fixed()){
-			p1_.pos_ += delta * diff;
-		}
-		else if(!p1_.fixed() && !p2_.fixed()){
-			p1_.pos_ += delta * 0.5 * diff;
-			p2_.pos_ -= delta * 0.5 * diff;
-		}
+	// Returns the error of the joint before it was corrected, see ParticleSystem::maintain_length.
+	T maintain_length(){
+		return system_->maintain_length(system_->index_of(handle_));
+	}
+
+	// Returns the first particle of the joint.
+	Particle<T> p1() const {
+		return Particle<T>(*system_, ParticleHandle{constraint().p1, handle_.generation});
+	}
+
+	// Returns the second particle of the joint.
+	Particle<T> p2() const {
+		return Particle<T>(*system_, ParticleHandle{constraint().p2, handle_.generation});
+	}
+
+	T length() const {
+		return constraint().length;
 	}
 
 	T x1() const {
-		return p1_.x();
+		return system_->x(constraint().p1);
 	}
 
 	T y1() const {
-		return p1_.y();
+		return system_->y(constraint().p1);
 	}
 
 	T x2() const {
-		return p2_.x();
+		return system_->x(constraint().p2);
 	}
 
 	T y2() const {
-		return p2_.y();
+		return system_->y(constraint().p2);
+	}
+
+	JointHandle handle() const {
+		return handle_;
 	}
 
 private:
-	T length_;
-	ParticleType p1_;
-	ParticleType p2_;
+	const JointConstraint<T>& constraint() const {
+		return system_->joint_constraint(system_->index_of(handle_));
+	}
+
+	// system the joint is stored in
+	ParticleSystem<T>* system_;
+
+	// handle of the joint within the system
+	JointHandle handle_;
 };
 
 }
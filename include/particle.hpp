@@ -1,114 +1,88 @@
 #pragma once
 
-#include <CGAL/Cartesian.h>
-#include <CGAL/Point_2.h>
-#include <CGAL/Vector_2.h>
-#include <CGAL/Iso_rectangle_2.h>
+#include <cstdint>
+
+#include "geometry.hpp"
 
 namespace physics {
 
+template <typename T> class ParticleSystem;
+
+// Identifies a particle stored in a ParticleSystem. The index is the position of the particle in
+// the system's arrays and the generation is the generation of the system the particle was created
+// in. A handle is only valid while its generation matches the system's, so a handle kept across a
+// scene change is detected instead of silently referring to another particle.
+struct ParticleHandle {
+	std::uint32_t index;
+	std::uint32_t generation;
+
+	bool operator==(const ParticleHandle& other) const = default;
+};
+
 // Represents a 2D particle who's position is updated using Verlet Integration.
 // As of now there is no support for particles of different masses but that
 // could be added in the future, without much difficulty.
+// The state of the particle lives in the contiguous arrays of the ParticleSystem that owns it,
+// a Particle is only a view holding the system and a handle, so it is cheap to copy and remains
+// valid when the system's storage grows.
 template <class T> class Particle {
 public:
-	using Point = CGAL::Point_2<CGAL::Cartesian<T>>;
-	using Vector = CGAL::Vector_2<CGAL::Cartesian<T>>;
-	using Rectangle = CGAL::Iso_rectangle_2<CGAL::Cartesian<T>>;
-	
-	// Constructs a particle at the given position which is subjet to the given acceleration.
-	Particle(T x, T y, bool fixed, Rectangle& bounding_box, Vector a) :
-		pos_(Point(x, y)),
-		prev_pos_(Point(x, y)),
-		a_(a),
-		bounding_box_(bounding_box),
-		fixed_(fixed)
-	{
-		stay_in_bounds();
-	}
+	using Point = Vector2<T>;
+	using Vector = Vector2<T>;
+	using Rectangle = Box2<T>;
+
+	// Constructs a view of the particle identified by handle in the given system.
+	Particle(ParticleSystem<T>& system, ParticleHandle handle) :
+		system_(&system),
+		handle_(handle)
+	{}
 
 	bool operator==(const Particle& other) const {
-		return pos_ == other.pos_;
-	}
-	
-	// Updates the position of the particle using Verlet Integration.
-	void update(T dt){
-		if(fixed_){
-			return;
-		}
-
-		Point tmp = pos_;
-		pos_ += (pos_ - prev_pos_) + (a_ * dt * dt);
-		prev_pos_ = tmp;
-
-		stay_in_bounds();
+		return system_ == other.system_ && handle_ == other.handle_;
 	}
 
-	// Makes sure that the particle is within boundaries of the system.
-	void stay_in_bounds(){
-		// check x boudaries
-		if(pos_.x() < bounding_box_.xmin()){
-			pos_ = Point(bounding_box_.xmin(), pos_.y());
-		}
-		else if(pos_.x() > bounding_box_.xmax()){
-			pos_ = Point(bounding_box_.xmax(), pos_.y());
-		}
-
-		// check y boundaries
-		if(pos_.y() < bounding_box_.ymin()){
-			pos_ = Point(pos_.x(), bounding_box_.ymin());
-		}
-		else if(pos_.y() > bounding_box_.ymax()){
-			pos_ = Point(pos_.x(), bounding_box_.ymax());
-		}
+	// Returns true if the particle still exists in its system.
+	bool valid() const {
+		return system_->valid(handle_);
 	}
 
 	// Moves the particle a given distance. Ignores if a particle is fixed or not but does make
 	// sure that the particle stays within the bounds of the system.
 	void move(T dx, T dy){
-		pos_ += Vector(dx, dy);
-		stay_in_bounds();
+		system_->move(system_->index_of(handle_), dx, dy);
 	}
 
 	// Sets the particles position. Ignores system boundaries.
 	void set_position(T x, T y){
-		pos_ = Point(x, y);
+		system_->set_position(system_->index_of(handle_), x, y);
 	}
 
 	bool fixed() const {
-		return fixed_;
+		return system_->fixed(system_->index_of(handle_));
 	}
 
 	T x() const {
-		return pos_.x();
+		return system_->x(system_->index_of(handle_));
 	}
 
 	T y() const {
-		return pos_.y();
+		return system_->y(system_->index_of(handle_));
 	}
 
 	Point pos() const {
-		return pos_;
+		return Point(x(), y());
 	}
 
-private:
-	// Joints need to be able to directly modify the position of particles
-	template <class U> friend class Joint;
-
-	// position of the particle
-	Point pos_;
-
-	// previous position of the particle
-	Point prev_pos_;
-
-	// constant accleration the particle is subject to
-	Vector a_;
+	ParticleHandle handle() const {
+		return handle_;
+	}
 
-	// bounding box of the system the particle is in
-	Rectangle& bounding_box_;
+private:
+	// system the particle is stored in
+	ParticleSystem<T>* system_;
 
-	// whether the particle is fixed to a point in space or not
-	bool fixed_;
+	// handle of the particle within the system
+	ParticleHandle handle_;
 };
 
 }
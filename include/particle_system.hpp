@@ -1,14 +1,116 @@
 #pragma once
 
-#include <utility>
-#include <list>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <span>
 #include <stdexcept>
+#include <utility>
+#include <vector>
 
 #include "particle.hpp"
 #include "joint.hpp"
+#include "profiler.hpp"
+#include "simd_kernels.hpp"
+#include "spatial_grid.hpp"
+#include "thread_pool.hpp"
 
 namespace physics {
 
+// An iterable range over all particles or joints of a ParticleSystem. The range yields views
+// (Particle or Joint) by value, so iterating it never copies any simulation state.
+template <class T, class View, class Handle> class SystemRange {
+public:
+	class iterator {
+	public:
+		iterator(ParticleSystem<T>* system, std::uint32_t index) : system_(system), index_(index) {}
+
+		View operator*() const {
+			return View(*system_, Handle{index_, system_->generation()});
+		}
+
+		iterator& operator++(){
+			++index_;
+			return *this;
+		}
+
+		bool operator==(const iterator& other) const = default;
+
+	private:
+		ParticleSystem<T>* system_;
+		std::uint32_t index_;
+	};
+
+	SystemRange(ParticleSystem<T>& system, std::size_t size) : system_(&system), size_(size) {}
+
+	iterator begin() const {
+		return iterator(system_, 0);
+	}
+
+	iterator end() const {
+		return iterator(system_, static_cast<std::uint32_t>(size_));
+	}
+
+	std::size_t size() const {
+		return size_;
+	}
+
+private:
+	ParticleSystem<T>* system_;
+	std::size_t size_;
+};
+
+template <class T> using ParticleRange = SystemRange<T, Particle<T>, ParticleHandle>;
+template <class T> using JointRange = SystemRange<T, Joint<T>, JointHandle>;
+
+// Configures the relaxation loop of a ParticleSystem. Every step runs relaxation iterations until
+// the largest joint error measured during an iteration is at most tolerance, but at least
+// min_iterations and at most max_iterations of them. The error of a joint is the difference
+// between its current and rest lengths relative to its current length. The default runs exactly
+// 10 iterations.
+template <class T> struct SolverConfig {
+	int min_iterations = 1;
+	int max_iterations = 10;
+	T tolerance = 0;
+};
+
+// What the relaxation loop of a ParticleSystem did in its last step: the number of iterations run,
+// the largest and root mean square joint errors measured during the last of them and the number
+// of collisions resolved in it.
+template <class T> struct SolverStats {
+	int iterations = 0;
+	T max_error = 0;
+	T rms_error = 0;
+	unsigned int contacts = 0;
+};
+
+// Configures collisions in a ParticleSystem. Particles are discs of the given radius that are kept
+// apart from each other and, if joints is true, from the joints they are not part of, which are
+// taken to be segments, except for particles joined to each other. Collisions are resolved in
+// every relaxation iteration, between the pairs found close enough to collide at the start of the
+// step with the grid of particle positions. Fixed and asleep particles are not moved by collisions,
+// asleep ones are woken when hit by a particle moving faster than the sleep threshold. The default
+// radius of 0 disables collisions.
+template <class T> struct CollisionConfig {
+	T radius = 0;
+	bool joints = true;
+};
+
+// Configures when islands of a ParticleSystem (sets of particles connected by joints, directly or
+// not) are put to sleep. An island falls asleep once the mean kinetic energy of its free particles,
+// with unit masses and velocities in distance per step, has stayed below threshold for the given
+// number of consecutive steps. Asleep islands are neither integrated nor relaxed until something
+// wakes them. The default threshold of 0 never puts an island to sleep.
+template <class T> struct SleepConfig {
+	T threshold = 0;
+	int steps = 30;
+};
+
 // Represents a system of Particles and Joints within a bounded box subject to constant gravity.
 template <typename T> class ParticleSystem {
 public:
@@ -16,95 +118,674 @@ public:
 	using Vector = typename Particle<T>::Vector;
 	using Rectangle = typename Particle<T>::Rectangle;
 
+	// Default size of the cells of the grid used to look up particles by position.
+	static constexpr T DEFAULT_CELL_SIZE = 20;
+
+	// Constructs an empty system. cell_size is the size of the cells of the grid used to look up
+	// particles by position, lookups are fastest when it is about the distance between particles.
 	ParticleSystem(
 		T lower_bound_x,
 		T upper_bound_x,
 		T lower_bound_y,
 		T upper_bound_y,
 		T gravity_x,
-		T gravity_y
+		T gravity_y,
+		T cell_size = DEFAULT_CELL_SIZE
 	) :
 		bounding_box_(Rectangle(Point(lower_bound_x, lower_bound_y), Point(upper_bound_x, upper_bound_y))),
-		gravity_(Vector(gravity_x, gravity_y))
+		gravity_(Vector(gravity_x, gravity_y)),
+		generation_(0),
+		unbatched_begin_(0),
+		batches_dirty_(false),
+		asleep_islands_(0),
+		asleep_particles_(0),
+		islands_dirty_(false),
+		awake_joints_dirty_(false),
+		grid_(cell_size),
+		grid_dirty_(false)
 	{}
 
-	// Returns the particle nearest the given position if it exists within the given radius. Returns nullptr otherwise.
+	// Views refer to the system by address, so a system can neither be copied nor moved.
+	ParticleSystem(const ParticleSystem&) = delete;
+	ParticleSystem& operator=(const ParticleSystem&) = delete;
+
+	// Returns the particle nearest the given position if it exists within the given radius. Returns nullopt otherwise.
 	// Preconditions: x, y must be representable as exact values or results are undefined.
-	Particle<T>* particle_near(T x, T y, T radius = 1){
+	std::optional<Particle<T>> particle_near(T x, T y, T radius = 1){
 		// Find a particle with a euclidian distance of less than radius from the given position.
-		Point target_pos(x, y);
-		T min_dist = radius;
-		Particle<T>* closest_particle = nullptr;
-		for(auto& p : particles_) {
-			Point pos = p.pos();
-			Vector vec = pos - target_pos;
-			T dist = vec.squared_length();
-			if(dist < (min_dist * min_dist)) {
-				closest_particle = &p;
+		// Ties between particles found are broken by index so the result does not depend on the
+		// layout of the grid.
+		T min_dist = radius * radius;
+		std::size_t closest = x_.size();
+		spatial_grid().query(x - radius, y - radius, x + radius, y + radius, [&](std::uint32_t i){
+			T dx = x_[i] - x;
+			T dy = y_[i] - y;
+			T dist = dx * dx + dy * dy;
+			if(dist < min_dist || (closest != x_.size() && dist == min_dist && i < closest)) {
+				closest = i;
 				min_dist = dist;
 			}
+		});
+		if(closest == x_.size()) {
+			return std::nullopt;
 		}
-		return closest_particle;
+		return particle(closest);
 	}
 
-	// Returns the particle at the given position if it exists. Returns nullptr if it does not.
-	// If two exist at the given position then it returns the first one that is found.
+	// Returns the particle at the given position if it exists. Returns nullopt if it does not.
+	// If two exist at the given position then it returns the one that was created first.
 	// Preconditions: x, y must be representable as exact values or results are undefined.
-	Particle<T>* particle_at(T x, T y){
-		for(auto& p : particles_) {
-			if(p.x() == x && p.y() == y){
-				return &p;
+	std::optional<Particle<T>> particle_at(T x, T y){
+		std::size_t found = x_.size();
+		spatial_grid().query(x, y, x, y, [&](std::uint32_t i){
+			if(x_[i] == x && y_[i] == y && i < found){
+				found = i;
 			}
+		});
+		if(found == x_.size()) {
+			return std::nullopt;
 		}
-		return nullptr;
+		return particle(found);
+	}
+
+	// Calls visit(particle index) for every particle within the given rectangle.
+	template <class F> void for_each_particle_in(T xmin, T ymin, T xmax, T ymax, F&& visit){
+		spatial_grid().query(xmin, ymin, xmax, ymax, [&](std::uint32_t i){
+			if(x_[i] >= xmin && x_[i] <= xmax && y_[i] >= ymin && y_[i] <= ymax){
+				visit(i);
+			}
+		});
+	}
+
+	// Calls visit(joint index) once for every joint whose bounding box overlaps the given
+	// rectangle. Joints are found through their particles with the grid, so the cost depends on
+	// the number of particles near the rectangle rather than on the size of the system. A joint
+	// stretched to more than twice the length of the longest joint with both of its particles
+	// outside the rectangle may be missed.
+	template <class F> void for_each_joint_in(T xmin, T ymin, T xmax, T ymax, F&& visit){
+		update_adjacency();
+		T margin = 2 * longest_joint_;
+		T gxmin = xmin - margin;
+		T gymin = ymin - margin;
+		T gxmax = xmax + margin;
+		T gymax = ymax + margin;
+		for_each_particle_in(gxmin, gymin, gxmax, gymax, [&](std::uint32_t i){
+			for(std::uint32_t k = adjacency_offsets_[i]; k < adjacency_offsets_[i + 1]; ++k){
+				// a joint with both particles in the grown rectangle is visited from the lower one
+				std::uint32_t other = adjacency_[k];
+				if(other < i && x_[other] >= gxmin && x_[other] <= gxmax && y_[other] >= gymin && y_[other] <= gymax){
+					continue;
+				}
+				if(std::max(x_[i], x_[other]) >= xmin && std::min(x_[i], x_[other]) <= xmax
+						&& std::max(y_[i], y_[other]) >= ymin && std::min(y_[i], y_[other]) <= ymax){
+					visit(adjacent_joints_[k]);
+				}
+			}
+		});
 	}
 
 	// Creates a new particle at the given position subject to the system's gravity and returns a
-	// reference to it.
-	Particle<T>& create_particle(T x, T y, bool fixed){
-		particles_.push_back(Particle<T>(x, y, fixed, bounding_box_, gravity_));
-		return particles_.back();
+	// view of it.
+	Particle<T> create_particle(T x, T y, bool fixed){
+		x_.push_back(x);
+		y_.push_back(y);
+		prev_x_.push_back(x);
+		prev_y_.push_back(y);
+		fixed_.push_back(fixed);
+		asleep_.push_back(false);
+		islands_dirty_ = true;
+
+		std::size_t i = x_.size() - 1;
+		stay_in_bounds(i);
+		if(!grid_dirty_){
+			grid_.insert(static_cast<std::uint32_t>(i), x_[i], y_[i]);
+		}
+		return particle(i);
 	}
 
-	// Creates a joint in the system between the two given particles. Retruns a reference to the
-	// joint created.
-	Joint<T>& create_joint(Particle<T>& p1, Particle<T>& p2){
-		joints_.push_back(Joint(p1, p2));
-		return joints_.back();
+	// Creates a joint in the system between the two given particles. The length of the joint is
+	// set to the distance between the two particles at the time of creation. Returns a view of
+	// the joint created.
+	Joint<T> create_joint(const Particle<T>& p1, const Particle<T>& p2){
+		std::uint32_t i1 = index_of(p1.handle());
+		std::uint32_t i2 = index_of(p2.handle());
+		if(i1 == i2 || (x_[i1] == x_[i2] && y_[i1] == y_[i2])) {
+			throw std::invalid_argument("Joint cannot be created between a particle and itself.");
+		}
+		T dx = x_[i2] - x_[i1];
+		T dy = y_[i2] - y_[i1];
+		joints_.push_back(JointConstraint<T>{i1, i2, std::sqrt(dx * dx + dy * dy)});
+		wake(i1);
+		wake(i2);
+		islands_dirty_ = true;
+		awake_joints_dirty_ = true;
+		batches_dirty_ = true;
+		return Joint<T>(*this, JointHandle{static_cast<std::uint32_t>(joints_.size() - 1), generation_});
+	}
+
+	// Creates a particle at each of the given positions and a joint between each of the given
+	// pairs of particle indices, which may refer to existing particles and to the new ones
+	// (numbered from particle_count() in the order given). Gives the same result as calling
+	// create_particle then create_joint for each of them, in a single pass over reserved storage.
+	// Nothing is created if an argument is invalid.
+	// Throws std::invalid_argument if the position arrays differ in size, if a joint refers to a
+	// particle that does not exist or if a joint connects two particles at the same position.
+	void append(std::span<const T> xs, std::span<const T> ys, std::span<const unsigned char> fixed,
+			std::span<const std::pair<std::uint32_t, std::uint32_t>> joints){
+		std::size_t n = xs.size();
+		if(ys.size() != n || fixed.size() != n){
+			throw std::invalid_argument("Particle arrays must all have the same size.");
+		}
+		std::size_t first = x_.size();
+		auto clamped = [&](std::uint32_t i){
+			if(i < first){
+				return std::make_pair(x_[i], y_[i]);
+			}
+			T x = std::min(std::max(xs[i - first], bounding_box_.xmin()), bounding_box_.xmax());
+			T y = std::min(std::max(ys[i - first], bounding_box_.ymin()), bounding_box_.ymax());
+			return std::make_pair(x, y);
+		};
+		for(const auto& [i1, i2] : joints){
+			if(i1 >= first + n || i2 >= first + n){
+				throw std::invalid_argument("Joint refers to a particle that does not exist.");
+			}
+			if(i1 == i2 || clamped(i1) == clamped(i2)){
+				throw std::invalid_argument("Joint cannot be created between a particle and itself.");
+			}
+		}
+
+		grow(x_, first + n);
+		grow(y_, first + n);
+		grow(prev_x_, first + n);
+		grow(prev_y_, first + n);
+		grow(fixed_, first + n);
+		grow(asleep_, first + n);
+		for(std::size_t i = 0; i < n; ++i){
+			x_.push_back(xs[i]);
+			y_.push_back(ys[i]);
+			prev_x_.push_back(xs[i]);
+			prev_y_.push_back(ys[i]);
+			fixed_.push_back(fixed[i]);
+			asleep_.push_back(false);
+			stay_in_bounds(first + i);
+		}
+
+		grow(joints_, joints_.size() + joints.size());
+		for(const auto& [i1, i2] : joints){
+			T dx = x_[i2] - x_[i1];
+			T dy = y_[i2] - y_[i1];
+			joints_.push_back(JointConstraint<T>{i1, i2, std::sqrt(dx * dx + dy * dy)});
+			wake(i1);
+			wake(i2);
+		}
+		islands_dirty_ = true;
+		awake_joints_dirty_ = true;
+		batches_dirty_ = true;
+		grid_dirty_ = true;
 	}
 
 	// Updates the simulation by a given timestep dt.
 	void update(T dt){
-		// updates positions of all particles as effected by gravity
-		for(auto& particle : particles_){
-			particle.update(dt);
+		PROFILE_SCOPE("update");
+		grid_dirty_ = true;
+		integrate(dt);
+		relax();
+		update_sleep();
+	}
+
+	// Updates the simulation by a given timestep dt while the ground (the lower bound of the
+	// system) moves by (ground_dx, ground_dy). Fixed particles move with the ground and stay on
+	// it, free particles touching the ground are carried by it. Moving the particles with the
+	// ground, integrating them and clamping them to the bounds is done in a single pass.
+	// Islands the ground moves are woken first, against the ground before it moves so that islands
+	// resting on a ground that drops fall with it.
+	void update(T dt, T ground_dx, T ground_dy){
+		PROFILE_SCOPE("update");
+		grid_dirty_ = true;
+		if(ground_dx != 0 || ground_dy != 0){
+			wake_grounded();
+		}
+		move_lower_bound(0, ground_dy);
+		step_particles<true>(dt, ground_dx, ground_dy);
+		relax();
+		update_sleep();
+	}
+
+	// Sets the number of threads used to relax the joints of the system. With a single thread
+	// (the default) joints are relaxed one after the other in the order they were created. With
+	// more, joints are partitioned into batches in which no two joints share a particle and each
+	// batch is relaxed across the threads, so the result is the same for any number of threads
+	// above one. It differs from the result with a single thread, which relaxes in another order.
+	void set_solver_threads(unsigned int threads){
+		if(threads <= 1){
+			pool_.reset();
+		}
+		else if(!pool_ || pool_->size() != threads){
+			pool_ = std::make_unique<ThreadPool>(threads);
+		}
+	}
+
+	// Returns the number of threads used to relax the joints of the system.
+	unsigned int solver_threads() const {
+		return pool_ ? pool_->size() : 1;
+	}
+
+	// Sets how many relaxation iterations are run per step, see SolverConfig.
+	void set_solver_config(const SolverConfig<T>& config){
+		solver_config_ = config;
+	}
+
+	const SolverConfig<T>& solver_config() const {
+		return solver_config_;
+	}
+
+	// Returns what the relaxation loop did in the last step.
+	const SolverStats<T>& solver_stats() const {
+		return stats_;
+	}
+
+	// Returns the timestep of the last step, or 0 if no step was taken yet.
+	T last_timestep() const {
+		return previous_dt_;
+	}
+
+	// Returns the largest distance a free particle that is awake moved by in the last step.
+	T max_displacement() const {
+		T max = 0;
+		for(std::size_t i = 0; i < x_.size(); ++i){
+			if(!fixed_[i] && !asleep_[i]){
+				T dx = x_[i] - prev_x_[i];
+				T dy = y_[i] - prev_y_[i];
+				max = std::max(max, dx * dx + dy * dy);
+			}
+		}
+		return std::sqrt(max);
+	}
+
+	// Sets whether the strain of every joint is recorded while relaxing, see strains().
+	void set_strain_tracking(bool enabled){
+		track_strain_ = enabled;
+		if(!enabled){
+			strains_.clear();
+		}
+	}
+
+	bool strain_tracking() const {
+		return track_strain_;
+	}
+
+	// Returns the strain of every joint, indexed like the joints, if strain tracking is enabled:
+	// its length divided by its rest length, minus 1, as measured by the last relaxation iteration
+	// of the last step it was relaxed in. Joints never relaxed since tracking was enabled have a
+	// strain of 0.
+	std::span<const T> strains() const {
+		return strains_;
+	}
+
+	// Sets how particles collide, see CollisionConfig.
+	void set_collision_config(const CollisionConfig<T>& config){
+		collision_config_ = config;
+	}
+
+	const CollisionConfig<T>& collision_config() const {
+		return collision_config_;
+	}
+
+	// Sets when islands are put to sleep, see SleepConfig. Disabling sleep wakes every island at
+	// the end of the next step.
+	void set_sleep_config(const SleepConfig<T>& config){
+		sleep_config_ = config;
+	}
+
+	const SleepConfig<T>& sleep_config() const {
+		return sleep_config_;
+	}
+
+	// Returns true if the particle at the given index is asleep.
+	bool asleep(std::size_t i) const {
+		return asleep_[i];
+	}
+
+	// Returns the number of particles that are asleep.
+	std::size_t asleep_count() const {
+		return asleep_particles_;
+	}
+
+	// Returns whether each particle is asleep (non-zero) or not, indexed like the particles.
+	std::span<const unsigned char> asleep_flags() const {
+		return asleep_;
+	}
+
+	// Returns the number of consecutive steps the island of the particle at the given index has
+	// been still for, see SleepConfig. Islands about to be recomputed count from 0.
+	std::int32_t quiet_steps(std::size_t i) const {
+		if(islands_dirty_){
+			return 0;
 		}
+		return islands_[island_of_[i]].quiet_steps;
+	}
 
-		// relaxation loop
-		// the number of iterations used partly determines the accuracy of the simulation
-		// less iterations results in the joints behaving less like rigid bodies and more like
-		// springs
-		for(int i = 0; i < 10; ++i){
-			for(auto& joint : joints_){
-				joint.maintain_length();
+	// Wakes every asleep island that has a fixed particle or touches the lower bound of the
+	// system, ie: every island moving the ground would move.
+	void wake_grounded(){
+		if(asleep_islands_ == 0){
+			return;
+		}
+		update_islands();
+		for(std::size_t k = 0; k < islands_.size(); ++k){
+			const Island& island = islands_[k];
+			if(island.asleep && (island.has_fixed || island.min_y <= bounding_box_.ymin())){
+				wake_island(k);
 			}
+		}
+	}
+
+	// Wakes the island of the particle at the given index if it is asleep.
+	void wake(std::size_t i){
+		if(asleep_[i]){
+			wake_island(island_of_[i]);
+		}
+	}
 
-			for(auto& particle : particles_){
-				particle.stay_in_bounds();
+	// Updates the positions of all particles as effected by gravity using Verlet Integration, then
+	// makes sure they stay within the bounds of the system.
+	void integrate(T dt){
+		grid_dirty_ = true;
+		step_particles<false>(dt, 0, 0);
+	}
+
+	// Maintains the length of the joint at the given index by moving the two particles closer or
+	// farther apart depending on the current distance between them. Returns the error of the
+	// joint before it was corrected, see maintain_length(const JointConstraint<T>&).
+	T maintain_length(std::size_t joint){
+		grid_dirty_ = true;
+		return maintain_length(joints_[joint]);
+	}
+
+	// Maintains the length of the given joint. Returns the error of the joint before it was
+	// corrected: the difference between its current and rest lengths relative to its current
+	// length.
+	T maintain_length(const JointConstraint<T>& c){
+		return maintain_length(c, nullptr);
+	}
+
+	// Maintains the length of the given joint like maintain_length(const JointConstraint<T>&) and,
+	// if strain is not null, stores the strain of the joint before it was corrected in it.
+	T maintain_length(const JointConstraint<T>& c, T* strain){
+		// computes the current distance between the two particles
+		T dx = x_[c.p2] - x_[c.p1];
+		T dy = y_[c.p2] - y_[c.p1];
+		T distance = std::sqrt(dx * dx + dy * dy);
+		T diff = (distance - c.length) / distance;
+		if(strain){
+			*strain = distance / c.length - 1;
+		}
+
+		// updates the position of the particles
+		bool fixed1 = fixed_[c.p1];
+		bool fixed2 = fixed_[c.p2];
+		if(fixed1 && !fixed2){
+			x_[c.p2] -= dx * diff;
+			y_[c.p2] -= dy * diff;
+		}
+		else if(fixed2 && !fixed1){
+			x_[c.p1] += dx * diff;
+			y_[c.p1] += dy * diff;
+		}
+		else if(!fixed1 && !fixed2){
+			x_[c.p1] += dx * T(0.5) * diff;
+			y_[c.p1] += dy * T(0.5) * diff;
+			x_[c.p2] -= dx * T(0.5) * diff;
+			y_[c.p2] -= dy * T(0.5) * diff;
+		}
+		return std::abs(diff);
+	}
+
+	// Makes sure that every particle is within the boundaries of the system.
+	void stay_in_bounds(){
+		PROFILE_SCOPE("stay_in_bounds");
+		grid_dirty_ = true;
+		for_each_range(x_.size(), [&](std::size_t begin, std::size_t end){
+			simd::clamp(x_.data() + begin, y_.data() + begin, end - begin,
+				bounding_box_.xmin(), bounding_box_.xmax(), bounding_box_.ymin(), bounding_box_.ymax());
+		});
+	}
+
+	// Makes sure that the particle at the given index is within the boundaries of the system.
+	void stay_in_bounds(std::size_t i){
+		// check x boudaries
+		if(x_[i] < bounding_box_.xmin()){
+			x_[i] = bounding_box_.xmin();
+		}
+		else if(x_[i] > bounding_box_.xmax()){
+			x_[i] = bounding_box_.xmax();
+		}
+
+		// check y boundaries
+		if(y_[i] < bounding_box_.ymin()){
+			y_[i] = bounding_box_.ymin();
+		}
+		else if(y_[i] > bounding_box_.ymax()){
+			y_[i] = bounding_box_.ymax();
+		}
+	}
+
+	// Returns a range over all particles in the system.
+	ParticleRange<T> particles(){
+		return ParticleRange<T>(*this, x_.size());
+	}
+
+	// Returns a range over all joints in the system.
+	JointRange<T> joints(){
+		return JointRange<T>(*this, joints_.size());
+	}
+
+	// Returns a view of the particle at the given index.
+	Particle<T> particle(std::size_t i){
+		return Particle<T>(*this, ParticleHandle{static_cast<std::uint32_t>(i), generation_});
+	}
+
+	std::size_t particle_count() const {
+		return x_.size();
+	}
+
+	std::size_t joint_count() const {
+		return joints_.size();
+	}
+
+	// Returns true if the handle refers to a particle of this system.
+	bool valid(ParticleHandle handle) const {
+		return handle.generation == generation_ && handle.index < x_.size();
+	}
+
+	// Returns true if the handle refers to a joint of this system.
+	bool valid(JointHandle handle) const {
+		return handle.generation == generation_ && handle.index < joints_.size();
+	}
+
+	// Returns the index of the particle identified by the handle.
+	// Throws std::out_of_range if the handle is not valid.
+	std::uint32_t index_of(ParticleHandle handle) const {
+		if(!valid(handle)){
+			throw std::out_of_range("Particle handle does not refer to a particle of this system.");
+		}
+		return handle.index;
+	}
+
+	// Returns the index of the joint identified by the handle.
+	// Throws std::out_of_range if the handle is not valid.
+	std::uint32_t index_of(JointHandle handle) const {
+		if(!valid(handle)){
+			throw std::out_of_range("Joint handle does not refer to a joint of this system.");
+		}
+		return handle.index;
+	}
+
+	// Returns the x coordinates of all particles, indexed like the particles.
+	std::span<const T> xs() const {
+		return x_;
+	}
+
+	// Returns the y coordinates of all particles, indexed like the particles.
+	std::span<const T> ys() const {
+		return y_;
+	}
+
+	// Returns the x coordinates of all particles before the last step, indexed like the particles.
+	std::span<const T> prev_xs() const {
+		return prev_x_;
+	}
+
+	// Returns the y coordinates of all particles before the last step, indexed like the particles.
+	std::span<const T> prev_ys() const {
+		return prev_y_;
+	}
+
+	// Returns whether each particle is fixed (non-zero) or not, indexed like the particles.
+	std::span<const unsigned char> fixed_flags() const {
+		return fixed_;
+	}
+
+	// Replaces every particle and joint of the system, eg: to restore a snapshot. The arrays are
+	// indexed like the particles and must all have the same size, and joints must only refer to
+	// particles of that size. Every island is awake afterwards and the system continues as if no
+	// step was taken yet, see restore_history. Handles given out before are invalidated.
+	// Throws std::invalid_argument if the arrays are inconsistent, the system is unchanged then.
+	void assign(std::span<const T> xs, std::span<const T> ys, std::span<const T> prev_xs, std::span<const T> prev_ys,
+			std::span<const unsigned char> fixed, std::span<const JointConstraint<T>> joints){
+		std::size_t n = xs.size();
+		if(ys.size() != n || prev_xs.size() != n || prev_ys.size() != n || fixed.size() != n){
+			throw std::invalid_argument("Particle arrays must all have the same size.");
+		}
+		for(const JointConstraint<T>& c : joints){
+			if(c.p1 >= n || c.p2 >= n){
+				throw std::invalid_argument("Joint refers to a particle that does not exist.");
 			}
 		}
+
+		x_.assign(xs.begin(), xs.end());
+		y_.assign(ys.begin(), ys.end());
+		prev_x_.assign(prev_xs.begin(), prev_xs.end());
+		prev_y_.assign(prev_ys.begin(), prev_ys.end());
+		fixed_.assign(fixed.begin(), fixed.end());
+		asleep_.assign(n, false);
+		joints_.assign(joints.begin(), joints.end());
+		++generation_;
+
+		strains_.clear();
+		stats_ = SolverStats<T>{};
+		previous_dt_ = 0;
+
+		islands_.clear();
+		asleep_islands_ = 0;
+		asleep_particles_ = 0;
+		islands_dirty_ = true;
+		// the cached indices refer to the joints of the last scene, which may have as many
+		awake_joints_.clear();
+		awake_joint_indices_.clear();
+		awake_joints_dirty_ = true;
+		batches_dirty_ = true;
+		grid_dirty_ = true;
+	}
+
+	// Restores what carries over from one step to the next besides the positions of the particles,
+	// eg: from a snapshot, after assign: the timestep of the last step, by which the velocity of the
+	// next one is scaled, and whether each particle is asleep and how many steps its island has been
+	// still for (see asleep_flags and quiet_steps), indexed like the particles. An island is asleep
+	// only if all of its particles are.
+	// Throws std::invalid_argument if the arrays are not of the size of the particles, the system
+	// is unchanged then.
+	void restore_history(T last_timestep, std::span<const unsigned char> asleep, std::span<const std::int32_t> quiet_steps){
+		if(asleep.size() != x_.size() || quiet_steps.size() != x_.size()){
+			throw std::invalid_argument("Sleep arrays must have the size of the particles.");
+		}
+		previous_dt_ = last_timestep;
+		asleep_.assign(asleep.begin(), asleep.end());
+		islands_dirty_ = true;
+		update_islands();
+		for(Island& island : islands_){
+			island.quiet_steps = quiet_steps[island_members_[island.begin]];
+		}
 	}
 
-	// Returns a reference to the list of all particles in the system.
-	std::list<Particle<T>>& particles(){
-		return particles_;
+	// Removes every particle and joint, eg: to build the next scene of a batch of runs. The memory
+	// of the arrays, the grid and the solver is kept for the next scene, so clearing costs nothing
+	// in the number of particles and building a scene no larger than the last allocates nothing.
+	// The bounds and configuration of the system are kept. Handles given out before are
+	// invalidated.
+	void clear(){
+		x_.clear();
+		y_.clear();
+		prev_x_.clear();
+		prev_y_.clear();
+		fixed_.clear();
+		asleep_.clear();
+		joints_.clear();
+		++generation_;
+
+		strains_.clear();
+		particle_contacts_.clear();
+		joint_contacts_.clear();
+		touched_.clear();
+		stats_ = SolverStats<T>{};
+		previous_dt_ = 0;
+
+		islands_.clear();
+		asleep_islands_ = 0;
+		asleep_particles_ = 0;
+		islands_dirty_ = true;
+		// the cached indices refer to the joints of the last scene, which may have as many
+		awake_joints_.clear();
+		awake_joint_indices_.clear();
+		awake_joints_dirty_ = true;
+		batches_dirty_ = true;
+		grid_dirty_ = true;
+	}
+
+	T x(std::size_t i) const {
+		return x_[i];
+	}
+
+	T y(std::size_t i) const {
+		return y_[i];
 	}
 
-	// Returns a reference to the list of all joints in the system.
-	std::list<Joint<T>>& joints(){
+	bool fixed(std::size_t i) const {
+		return fixed_[i];
+	}
+
+	// Sets the position of the particle at the given index. Ignores system boundaries.
+	void set_position(std::size_t i, T x, T y){
+		grid_dirty_ = true;
+		wake(i);
+		x_[i] = x;
+		y_[i] = y;
+	}
+
+	// Moves the particle at the given index a given distance. Ignores if a particle is fixed or
+	// not but does make sure that the particle stays within the bounds of the system.
+	void move(std::size_t i, T dx, T dy){
+		grid_dirty_ = true;
+		wake(i);
+		x_[i] += dx;
+		y_[i] += dy;
+		stay_in_bounds(i);
+	}
+
+	const JointConstraint<T>& joint_constraint(std::size_t i) const {
+		return joints_[i];
+	}
+
+	// Returns the constraints of all joints, indexed like the joints.
+	std::span<const JointConstraint<T>> joint_constraints() const {
 		return joints_;
 	}
 
+	// Returns the generation of the system. Handles created in another generation are invalid.
+	std::uint32_t generation() const {
+		return generation_;
+	}
+
 	// Moves the lower bound of the system.
 	void move_lower_bound(T dx, T dy){
 		bounding_box_ = Rectangle(bounding_box_.min() + Vector(dx, dy), bounding_box_.max());
@@ -123,18 +804,729 @@ public:
 private:
 	// Actual bounding box of the system, all particles must stay within this box.
 	Rectangle bounding_box_;
-	
+
 	// Constant acceleration that all particles in the system are subject to.
 	Vector gravity_;
 
-	// Lists of all particles and joints in the system.
-	// It is important that the particles and joints are stored in lists instead of vectors because
-	// std::list guarantees that references to elements are valid as long as the element that the
-	// reference points to is in the list (ie: the elements has not been erased from the list). 
-	// This program uses references to elements in these lists extensively, so even though there is
-	// a small performance hit iterating through lists compared to vectors, it is neccessary.
-	std::list<Particle<T>> particles_;
-	std::list<Joint<T>> joints_;
+	// Particles are stored as a structure of arrays so that the integration and relaxation loops
+	// walk contiguous memory. Since the arrays may be reallocated when they grow, the rest of the
+	// program refers to particles and joints through handles (indices checked against the
+	// generation of the system) instead of references.
+	std::vector<T> x_;
+	std::vector<T> y_;
+	std::vector<T> prev_x_;
+	std::vector<T> prev_y_;
+	std::vector<unsigned char> fixed_;
+	std::vector<unsigned char> asleep_;
+
+	// Joints are stored as the indices of the particles they connect plus their length.
+	std::vector<JointConstraint<T>> joints_;
+
+	// Generation of the system, part of every handle given out.
+	std::uint32_t generation_;
+
+	// Returns the grid of particle positions, rebuilding it first if particles moved since it
+	// was last built.
+	const SpatialGrid<T>& spatial_grid(){
+		if(grid_dirty_ || grid_.overloaded()){
+			grid_.rebuild(x_.data(), y_.data(), x_.size());
+			grid_dirty_ = false;
+		}
+		return grid_;
+	}
+
+	// Running maximum and sum of squares of joint errors over a relaxation iteration.
+	struct ErrorAccumulator {
+		T max = 0;
+		T sum_squares = 0;
+		std::size_t count = 0;
+
+		void add(T error){
+			max = std::max(max, error);
+			sum_squares += error * error;
+			++count;
+		}
+
+		void add(const ErrorAccumulator& other){
+			max = std::max(max, other.max);
+			sum_squares += other.sum_squares;
+			count += other.count;
+		}
+	};
+
+	// relaxation loop
+	// the number of iterations used partly determines the accuracy of the simulation
+	// less iterations results in the joints behaving less like rigid bodies and more like
+	// springs
+	void relax(){
+		stats_ = SolverStats<T>{};
+		int max_iterations = std::max(solver_config_.max_iterations, 1);
+		bool collide = collision_config_.radius > 0;
+		if(collide){
+			find_contacts();
+		}
+		// the strains are overwritten by every iteration, the last one run leaving its own
+		T* strains = nullptr;
+		if(track_strain_){
+			strains_.resize(joints_.size(), T(0));
+			strains = strains_.data();
+		}
+		if(!pool_){
+			const std::vector<JointConstraint<T>>& joints = awake_joints();
+			const std::vector<std::uint32_t>& indices = awake_joint_indices();
+			for(int i = 0; i < max_iterations; ++i){
+				PROFILE_SCOPE("relax iteration");
+				ErrorAccumulator errors;
+				if(strains){
+					for(std::size_t j = 0; j < joints.size(); ++j){
+						errors.add(maintain_length(joints[j], strains + indices[j]));
+					}
+				}
+				else {
+					for(const JointConstraint<T>& joint : joints){
+						errors.add(maintain_length(joint));
+					}
+				}
+				if(collide){
+					stats_.contacts = resolve_contacts();
+				}
+
+				stay_in_bounds();
+				if(converged(i, errors)){
+					break;
+				}
+			}
+			wake_touched();
+			return;
+		}
+
+		// parallel relaxation, joints in a batch share no particles so they can be processed
+		// concurrently and in any order
+		// the errors are summed per chunk of ERROR_CHUNK_JOINTS joints then over the chunks in
+		// order, so that the statistics, and the iterations the tolerance stops at, do not depend
+		// on how the batches are split across the threads
+		update_batches();
+		for(int i = 0; i < max_iterations; ++i){
+			PROFILE_SCOPE("relax iteration");
+			ErrorAccumulator errors;
+			for(std::size_t b = 0; b + 1 < batch_offsets_.size(); ++b){
+				std::size_t begin = batch_offsets_[b];
+				std::size_t end = batch_offsets_[b + 1];
+				if(end - begin < MIN_PARALLEL_JOINTS || begin >= unbatched_begin_){
+					for(std::size_t j = begin; j < end; ++j){
+						errors.add(maintain_length(batches_[j], strains ? strains + batch_indices_[j] : nullptr));
+					}
+					continue;
+				}
+				std::size_t chunks = (end - begin + ERROR_CHUNK_JOINTS - 1) / ERROR_CHUNK_JOINTS;
+				chunk_errors_.assign(chunks, ErrorAccumulator{});
+				pool_->parallel_for(chunks, [&](std::size_t first, std::size_t last){
+					for(std::size_t c = first; c < last; ++c){
+						ErrorAccumulator local;
+						std::size_t chunk_end = std::min(end, begin + (c + 1) * ERROR_CHUNK_JOINTS);
+						for(std::size_t j = begin + c * ERROR_CHUNK_JOINTS; j < chunk_end; ++j){
+							local.add(maintain_length(batches_[j], strains ? strains + batch_indices_[j] : nullptr));
+						}
+						chunk_errors_[c] = local;
+					}
+				});
+				for(const ErrorAccumulator& chunk : chunk_errors_){
+					errors.add(chunk);
+				}
+			}
+			if(collide){
+				stats_.contacts = resolve_contacts();
+			}
+
+			stay_in_bounds();
+			if(converged(i, errors)){
+				break;
+			}
+		}
+		wake_touched();
+	}
+
+	// Returns true if collisions do not move the particle at the given index.
+	bool is_static(std::uint32_t i) const {
+		return fixed_[i] || asleep_[i];
+	}
+
+	// Finds the pairs of particles, and of particles and joints, close enough that they may collide
+	// during the step using the grid of particle positions, so the cost is linear in the number of
+	// particles and joints. Pairs are searched within half a radius more than the contact distance
+	// so that pairs coming closer during relaxation are found too.
+	void find_contacts(){
+		PROFILE_SCOPE("broadphase");
+		particle_contacts_.clear();
+		joint_contacts_.clear();
+		update_adjacency();
+
+		T radius = collision_config_.radius;
+		T reach = radius * T(2.5);
+		const SpatialGrid<T>& grid = spatial_grid();
+		std::uint32_t n = static_cast<std::uint32_t>(x_.size());
+		for(std::uint32_t i = 0; i < n; ++i){
+			grid.query(x_[i] - reach, y_[i] - reach, x_[i] + reach, y_[i] + reach, [&](std::uint32_t j){
+				if(j > i && std::abs(x_[j] - x_[i]) <= reach && std::abs(y_[j] - y_[i]) <= reach
+						&& (!is_static(i) || !is_static(j)) && !joined(i, j)){
+					particle_contacts_.emplace_back(i, j);
+				}
+			});
+		}
+		if(!collision_config_.joints){
+			return;
+		}
+
+		reach = radius * T(1.5);
+		for(std::uint32_t k = 0; k < joints_.size(); ++k){
+			const JointConstraint<T>& joint = joints_[k];
+			T xmin = std::min(x_[joint.p1], x_[joint.p2]) - reach;
+			T xmax = std::max(x_[joint.p1], x_[joint.p2]) + reach;
+			T ymin = std::min(y_[joint.p1], y_[joint.p2]) - reach;
+			T ymax = std::max(y_[joint.p1], y_[joint.p2]) + reach;
+			bool joint_static = is_static(joint.p1) && is_static(joint.p2);
+			grid.query(xmin, ymin, xmax, ymax, [&](std::uint32_t p){
+				if(x_[p] < xmin || x_[p] > xmax || y_[p] < ymin || y_[p] > ymax || (joint_static && is_static(p))){
+					return;
+				}
+				if(p == joint.p1 || p == joint.p2 || joined(p, joint.p1) || joined(p, joint.p2)){
+					return;
+				}
+				joint_contacts_.emplace_back(p, k);
+			});
+		}
+	}
+
+	// Lists the particles and joints joined to every particle if joints were created since it was
+	// last done.
+	void update_adjacency(){
+		std::size_t n = x_.size();
+		if(adjacency_offsets_.size() == n + 1 && adjacency_joints_ == joints_.size() && adjacency_generation_ == generation_){
+			return;
+		}
+		adjacency_offsets_.assign(n + 1, 0);
+		for(const JointConstraint<T>& joint : joints_){
+			++adjacency_offsets_[joint.p1 + 1];
+			++adjacency_offsets_[joint.p2 + 1];
+		}
+		for(std::size_t i = 0; i < n; ++i){
+			adjacency_offsets_[i + 1] += adjacency_offsets_[i];
+		}
+		adjacency_.resize(2 * joints_.size());
+		adjacent_joints_.resize(2 * joints_.size());
+		longest_joint_ = 0;
+		std::vector<std::uint32_t> next(adjacency_offsets_.begin(), adjacency_offsets_.end() - 1);
+		for(std::uint32_t k = 0; k < joints_.size(); ++k){
+			const JointConstraint<T>& joint = joints_[k];
+			adjacent_joints_[next[joint.p1]] = k;
+			adjacency_[next[joint.p1]++] = joint.p2;
+			adjacent_joints_[next[joint.p2]] = k;
+			adjacency_[next[joint.p2]++] = joint.p1;
+			longest_joint_ = std::max(longest_joint_, joint.length);
+		}
+		adjacency_joints_ = joints_.size();
+		adjacency_generation_ = generation_;
+	}
+
+	// Returns true if a joint connects the particles at the given indices. Particles that are
+	// joined do not collide, so that structures finer than the particles hold together.
+	bool joined(std::uint32_t a, std::uint32_t b) const {
+		for(std::uint32_t k = adjacency_offsets_[a]; k < adjacency_offsets_[a + 1]; ++k){
+			if(adjacency_[k] == b){
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Pushes apart the pairs found by find_contacts that overlap, moving each particle in
+	// proportion to its share of the correction (none for fixed and asleep particles). Asleep
+	// particles hit by a moving one are recorded to be woken at the end of the step. Returns the
+	// number of pairs that overlapped.
+	unsigned int resolve_contacts(){
+		T radius = collision_config_.radius;
+		T diameter = 2 * radius;
+		unsigned int contacts = 0;
+		for(const auto& [i, j] : particle_contacts_){
+			T dx = x_[j] - x_[i];
+			T dy = y_[j] - y_[i];
+			T dist2 = dx * dx + dy * dy;
+			if(dist2 >= diameter * diameter){
+				continue;
+			}
+			T wi = is_static(i) ? T(0) : T(1);
+			T wj = is_static(j) ? T(0) : T(1);
+			T c;
+			if(dist2 == 0){
+				// coincident particles have no direction between them, they are pushed apart
+				// along x, the first created to the left
+				dx = 1;
+				dy = 0;
+				c = diameter / (wi + wj);
+			}
+			else {
+				T dist = std::sqrt(dist2);
+				c = (diameter - dist) / (dist * (wi + wj));
+			}
+			x_[i] -= dx * c * wi;
+			y_[i] -= dy * c * wi;
+			x_[j] += dx * c * wj;
+			y_[j] += dy * c * wj;
+			if(moving(i) || moving(j)){
+				touch(i);
+				touch(j);
+			}
+			++contacts;
+		}
+		for(const auto& [p, joint] : joint_contacts_){
+			const JointConstraint<T>& c = joints_[joint];
+			T abx = x_[c.p2] - x_[c.p1];
+			T aby = y_[c.p2] - y_[c.p1];
+			T length2 = abx * abx + aby * aby;
+			if(length2 == 0){
+				continue;
+			}
+			T t = std::clamp(((x_[p] - x_[c.p1]) * abx + (y_[p] - y_[c.p1]) * aby) / length2, T(0), T(1));
+			T dx = x_[p] - (x_[c.p1] + t * abx);
+			T dy = y_[p] - (y_[c.p1] + t * aby);
+			T dist2 = dx * dx + dy * dy;
+			if(dist2 >= radius * radius){
+				continue;
+			}
+			T wp = is_static(p) ? T(0) : T(1);
+			T w1 = is_static(c.p1) ? T(0) : T(1 - t);
+			T w2 = is_static(c.p2) ? T(0) : t;
+			T weight = wp + w1 * w1 + w2 * w2;
+			if(weight == 0){
+				continue;
+			}
+			T lambda;
+			if(dist2 == 0){
+				// a particle on the joint is pushed off it to the left of the joint, from p1 to p2
+				T length = std::sqrt(length2);
+				dx = -aby / length;
+				dy = abx / length;
+				lambda = radius / weight;
+			}
+			else {
+				T dist = std::sqrt(dist2);
+				lambda = (radius - dist) / (dist * weight);
+			}
+			x_[p] += dx * lambda * wp;
+			y_[p] += dy * lambda * wp;
+			x_[c.p1] -= dx * lambda * w1;
+			y_[c.p1] -= dy * lambda * w1;
+			x_[c.p2] -= dx * lambda * w2;
+			y_[c.p2] -= dy * lambda * w2;
+			if(moving(p) || moving(c.p1) || moving(c.p2)){
+				touch(p);
+				touch(c.p1);
+				touch(c.p2);
+			}
+			++contacts;
+		}
+		return contacts;
+	}
+
+	// Returns true if the particle at the given index moves fast enough to wake the particles it
+	// collides with: it is not static and its kinetic energy is at least the sleep threshold. A
+	// structure resting on an asleep one then does not keep waking it.
+	bool moving(std::uint32_t i) const {
+		T vx = x_[i] - prev_x_[i];
+		T vy = y_[i] - prev_y_[i];
+		return !is_static(i) && (vx * vx + vy * vy) / 2 >= sleep_config_.threshold;
+	}
+
+	// Records the particle at the given index to be woken at the end of the step if it is asleep.
+	void touch(std::uint32_t i){
+		if(asleep_[i]){
+			touched_.push_back(i);
+		}
+	}
+
+	// Wakes the particles touched by collisions during the step.
+	void wake_touched(){
+		for(std::uint32_t i : touched_){
+			wake(i);
+		}
+		touched_.clear();
+	}
+
+	// Records the errors of relaxation iteration i (counting from 0) in the solver statistics and
+	// returns true if the solver may stop after it.
+	bool converged(int i, const ErrorAccumulator& errors){
+		stats_.iterations = i + 1;
+		stats_.max_error = errors.max;
+		stats_.rms_error = errors.count == 0 ? T(0) : std::sqrt(errors.sum_squares / errors.count);
+		return stats_.iterations >= solver_config_.min_iterations && errors.max <= solver_config_.tolerance;
+	}
+
+	// Moves, integrates and clamps all particles in one pass using the vectorized kernel, see
+	// simd::step.
+	// The motion of the previous step is scaled by the ratio of the timesteps so that the velocity
+	// is kept when the timestep changes.
+	template <bool Shake> void step_particles(T dt, T ground_dx, T ground_dy){
+		PROFILE_SCOPE("integrate");
+		T velocity_scale = previous_dt_ > 0 ? dt / previous_dt_ : T(1);
+		previous_dt_ = dt;
+		simd::StepParams<T> params{
+			ground_dx,
+			ground_dy,
+			gravity_.x() * dt * dt,
+			gravity_.y() * dt * dt,
+			velocity_scale,
+			bounding_box_.xmin(),
+			bounding_box_.xmax(),
+			bounding_box_.ymin(),
+			bounding_box_.ymax()
+		};
+		for_each_range(x_.size(), [&](std::size_t begin, std::size_t end){
+			simd::step<Shake>(x_.data() + begin, y_.data() + begin, prev_x_.data() + begin, prev_y_.data() + begin,
+				fixed_.data() + begin, asleep_.data() + begin, end - begin, params);
+		});
+	}
+
+	// Calls fn(begin, end) on ranges partitioning [0, n), across the solver threads if there are
+	// enough elements for it to pay off.
+	template <class F> void for_each_range(std::size_t n, F&& fn){
+		if(pool_ && n >= MIN_PARALLEL_PARTICLES){
+			pool_->parallel_for(n, fn);
+		}
+		else {
+			fn(std::size_t(0), n);
+		}
+	}
+
+	// Partitions the awake joints into batches in which no two joints share a particle if joints
+	// were created or islands fell asleep or woke since the batches were last computed. Joints are greedily given the lowest batch
+	// not used by a joint of either of their particles. Joints that would need a batch beyond the
+	// first 64 are put in a last batch which is processed sequentially.
+	void update_batches(){
+		if(!batches_dirty_){
+			return;
+		}
+		batches_dirty_ = false;
+
+		constexpr int MAX_BATCHES = 64;
+		const std::vector<JointConstraint<T>>& joints = awake_joints();
+		const std::vector<std::uint32_t>& indices = awake_joint_indices();
+		std::vector<std::uint64_t> used(x_.size(), 0);
+		std::vector<int> batch(joints.size());
+		std::vector<std::size_t> counts(MAX_BATCHES + 1, 0);
+		for(std::size_t j = 0; j < joints.size(); ++j){
+			const JointConstraint<T>& c = joints[j];
+			std::uint64_t free = ~(used[c.p1] | used[c.p2]);
+			int b = MAX_BATCHES;
+			if(free){
+				b = std::countr_zero(free);
+				used[c.p1] |= std::uint64_t(1) << b;
+				used[c.p2] |= std::uint64_t(1) << b;
+			}
+			batch[j] = b;
+			++counts[b];
+		}
+
+		// counting sort the joints by batch, keeping creation order within a batch
+		batch_offsets_.assign(1, 0);
+		for(int b = 0; b <= MAX_BATCHES; ++b){
+			if(counts[b] > 0 || b == MAX_BATCHES){
+				batch_offsets_.push_back(batch_offsets_.back() + counts[b]);
+			}
+		}
+		std::vector<std::size_t> next(MAX_BATCHES + 1, 0);
+		for(int b = 0, k = 0; b <= MAX_BATCHES; ++b){
+			if(counts[b] > 0 || b == MAX_BATCHES){
+				next[b] = batch_offsets_[k++];
+			}
+		}
+		unbatched_begin_ = next[MAX_BATCHES];
+		batches_.resize(joints.size());
+		batch_indices_.resize(joints.size());
+		for(std::size_t j = 0; j < joints.size(); ++j){
+			std::size_t k = next[batch[j]]++;
+			batches_[k] = joints[j];
+			batch_indices_[k] = indices[j];
+		}
+	}
+
+	// Reserves storage for at least size elements in v, growing it geometrically so that appending
+	// many small batches copies every element a constant number of times.
+	template <class U> static void grow(std::vector<U>& v, std::size_t size){
+		if(v.capacity() < size){
+			v.reserve(std::max(size, 2 * v.capacity()));
+		}
+	}
+
+	// Returns the joints that are not asleep, in creation order.
+	const std::vector<JointConstraint<T>>& awake_joints(){
+		if(asleep_islands_ == 0){
+			return joints_;
+		}
+		if(awake_joints_dirty_){
+			awake_joints_.clear();
+			awake_joint_indices_.clear();
+			for(std::size_t j = 0; j < joints_.size(); ++j){
+				if(!asleep_[joints_[j].p1]){
+					awake_joints_.push_back(joints_[j]);
+					awake_joint_indices_.push_back(static_cast<std::uint32_t>(j));
+				}
+			}
+			awake_joints_dirty_ = false;
+		}
+		return awake_joints_;
+	}
+
+	// Returns the index of every joint returned by awake_joints(), which must be called first.
+	const std::vector<std::uint32_t>& awake_joint_indices(){
+		if(asleep_islands_ == 0){
+			// all joints are awake
+			if(awake_joint_indices_.size() != joints_.size()){
+				awake_joint_indices_.resize(joints_.size());
+				std::iota(awake_joint_indices_.begin(), awake_joint_indices_.end(), std::uint32_t(0));
+				awake_joints_dirty_ = true;
+			}
+		}
+		return awake_joint_indices_;
+	}
+
+	// Recomputes the islands if particles or joints were created since they were last computed.
+	// Islands are numbered in the order of their first particle. A new island is asleep only if
+	// all of its particles were, otherwise all of them are woken.
+	void update_islands(){
+		if(!islands_dirty_){
+			return;
+		}
+		islands_dirty_ = false;
+
+		// union find over the joints, the root of a set is its lowest particle
+		std::size_t n = x_.size();
+		std::vector<std::uint32_t> parent(n);
+		for(std::size_t i = 0; i < n; ++i){
+			parent[i] = static_cast<std::uint32_t>(i);
+		}
+		auto find = [&](std::uint32_t i){
+			while(parent[i] != i){
+				parent[i] = parent[parent[i]];
+				i = parent[i];
+			}
+			return i;
+		};
+		for(const JointConstraint<T>& c : joints_){
+			std::uint32_t a = find(c.p1);
+			std::uint32_t b = find(c.p2);
+			if(a != b){
+				parent[std::max(a, b)] = std::min(a, b);
+			}
+		}
+
+		// number the islands and group their particles, counting sort keeps them in index order
+		island_of_.resize(n);
+		std::vector<std::uint32_t> counts;
+		for(std::size_t i = 0; i < n; ++i){
+			std::uint32_t root = find(static_cast<std::uint32_t>(i));
+			if(root == i){
+				island_of_[i] = static_cast<std::uint32_t>(counts.size());
+				counts.push_back(0);
+			}
+			else {
+				island_of_[i] = island_of_[root];
+			}
+			++counts[island_of_[i]];
+		}
+		islands_.assign(counts.size(), Island{});
+		std::uint32_t offset = 0;
+		for(std::size_t k = 0; k < islands_.size(); ++k){
+			islands_[k].begin = offset;
+			islands_[k].end = offset;
+			offset += counts[k];
+		}
+		island_members_.resize(n);
+		for(std::size_t i = 0; i < n; ++i){
+			island_members_[islands_[island_of_[i]].end++] = static_cast<std::uint32_t>(i);
+		}
+
+		asleep_islands_ = 0;
+		asleep_particles_ = 0;
+		for(Island& island : islands_){
+			bool all_asleep = true;
+			island.min_y = y_[island_members_[island.begin]];
+			for(std::uint32_t k = island.begin; k < island.end; ++k){
+				std::uint32_t i = island_members_[k];
+				all_asleep = all_asleep && asleep_[i];
+				island.has_fixed = island.has_fixed || fixed_[i];
+				island.min_y = std::min(island.min_y, y_[i]);
+			}
+			island.asleep = all_asleep;
+			for(std::uint32_t k = island.begin; k < island.end; ++k){
+				asleep_[island_members_[k]] = all_asleep;
+			}
+			if(all_asleep){
+				++asleep_islands_;
+				asleep_particles_ += island.end - island.begin;
+			}
+		}
+		awake_joints_dirty_ = true;
+		batches_dirty_ = true;
+	}
+
+	// Puts the islands that have been still for long enough to sleep, see SleepConfig.
+	void update_sleep(){
+		PROFILE_SCOPE("sleep");
+		if(sleep_config_.threshold <= 0){
+			if(asleep_islands_ > 0){
+				for(std::size_t k = 0; k < islands_.size(); ++k){
+					if(islands_[k].asleep){
+						wake_island(k);
+					}
+				}
+			}
+			return;
+		}
+
+		update_islands();
+		for(std::size_t k = 0; k < islands_.size(); ++k){
+			Island& island = islands_[k];
+			if(island.asleep){
+				continue;
+			}
+			T energy = 0;
+			std::size_t free = 0;
+			for(std::uint32_t m = island.begin; m < island.end; ++m){
+				std::uint32_t i = island_members_[m];
+				if(!fixed_[i]){
+					T vx = x_[i] - prev_x_[i];
+					T vy = y_[i] - prev_y_[i];
+					energy += vx * vx + vy * vy;
+					++free;
+				}
+			}
+			if(free > 0){
+				energy /= 2 * free;
+			}
+			if(energy >= sleep_config_.threshold){
+				island.quiet_steps = 0;
+			}
+			else if(++island.quiet_steps >= sleep_config_.steps){
+				sleep_island(k);
+			}
+		}
+	}
+
+	// Puts the island with the given index to sleep. Its particles lose their velocity.
+	void sleep_island(std::size_t k){
+		Island& island = islands_[k];
+		island.asleep = true;
+		island.min_y = y_[island_members_[island.begin]];
+		for(std::uint32_t m = island.begin; m < island.end; ++m){
+			std::uint32_t i = island_members_[m];
+			asleep_[i] = true;
+			prev_x_[i] = x_[i];
+			prev_y_[i] = y_[i];
+			island.min_y = std::min(island.min_y, y_[i]);
+		}
+		++asleep_islands_;
+		asleep_particles_ += island.end - island.begin;
+		awake_joints_dirty_ = true;
+		batches_dirty_ = true;
+	}
+
+	// Wakes the island with the given index.
+	void wake_island(std::size_t k){
+		Island& island = islands_[k];
+		island.asleep = false;
+		island.quiet_steps = 0;
+		for(std::uint32_t m = island.begin; m < island.end; ++m){
+			asleep_[island_members_[m]] = false;
+		}
+		--asleep_islands_;
+		asleep_particles_ -= island.end - island.begin;
+		awake_joints_dirty_ = true;
+		batches_dirty_ = true;
+	}
+
+	// Batches smaller than this are relaxed on the calling thread, splitting them costs more
+	// than it saves.
+	static constexpr std::size_t MIN_PARALLEL_JOINTS = 256;
+
+	// Joints of a batch relaxed in parallel whose errors are summed together before being added to
+	// the errors of the iteration, see relax.
+	static constexpr std::size_t ERROR_CHUNK_JOINTS = 64;
+	std::vector<ErrorAccumulator> chunk_errors_;
+	static constexpr std::size_t MIN_PARALLEL_PARTICLES = 4096;
+
+	// Iteration limits and tolerance of the relaxation loop, and what it did in the last step.
+	SolverConfig<T> solver_config_;
+	SolverStats<T> stats_;
+
+	// Timestep of the last step, 0 before the first one
+	T previous_dt_ = 0;
+
+	// Whether joint strains are recorded and the strain of every joint, see strains().
+	bool track_strain_ = false;
+	std::vector<T> strains_;
+
+	// How particles collide, the pairs that may collide during the current step (particle
+	// indices, and particle and joint indices) and the asleep particles touched during it.
+	CollisionConfig<T> collision_config_;
+	std::vector<std::pair<std::uint32_t, std::uint32_t>> particle_contacts_;
+	std::vector<std::pair<std::uint32_t, std::uint32_t>> joint_contacts_;
+	std::vector<std::uint32_t> touched_;
+
+	// The particles joined to every particle, those of particle i being
+	// adjacency_[adjacency_offsets_[i], adjacency_offsets_[i + 1]), and the joints joining them in
+	// adjacent_joints_ at the same positions, as of the given number of joints and generation.
+	// longest_joint_ is the greatest length of these joints.
+	std::vector<std::uint32_t> adjacency_offsets_;
+	std::vector<std::uint32_t> adjacency_;
+	std::vector<std::uint32_t> adjacent_joints_;
+	T longest_joint_ = 0;
+	std::size_t adjacency_joints_ = 0;
+	std::uint32_t adjacency_generation_ = 0;
+
+	// Threads used for the parallel relaxation, null when relaxing sequentially.
+	std::unique_ptr<ThreadPool> pool_;
+
+	// Copies of the joints ordered by batch, batch b being [batch_offsets_[b], batch_offsets_[b + 1]),
+	// and their indices. The joints from unbatched_begin_ on could not be batched and must be
+	// relaxed sequentially.
+	std::vector<JointConstraint<T>> batches_;
+	std::vector<std::uint32_t> batch_indices_;
+	std::vector<std::size_t> batch_offsets_;
+	std::size_t unbatched_begin_;
+	bool batches_dirty_;
+
+	// A set of particles connected by joints, its particles are
+	// island_members_[begin, end). min_y is the lowest position of its particles when it fell
+	// asleep.
+	struct Island {
+		std::uint32_t begin = 0;
+		std::uint32_t end = 0;
+		bool asleep = false;
+		bool has_fixed = false;
+		int quiet_steps = 0;
+		T min_y = 0;
+	};
+
+	// When islands are put to sleep, the island of every particle and the particles of every
+	// island. The islands are recomputed lazily when particles or joints are created.
+	SleepConfig<T> sleep_config_;
+	std::vector<Island> islands_;
+	std::vector<std::uint32_t> island_of_;
+	std::vector<std::uint32_t> island_members_;
+	std::size_t asleep_islands_;
+	std::size_t asleep_particles_;
+	bool islands_dirty_;
+
+	// Copies of the joints of the awake islands and their indices, only used while some island is
+	// asleep. While none is the indices are those of all joints.
+	std::vector<JointConstraint<T>> awake_joints_;
+	std::vector<std::uint32_t> awake_joint_indices_;
+	bool awake_joints_dirty_;
+
+	// Grid of particle positions used for lookups. New particles are inserted as they are
+	// created, when particles move the grid is marked dirty and rebuilt on the next lookup.
+	SpatialGrid<T> grid_;
+	bool grid_dirty_;
 };
 
 }
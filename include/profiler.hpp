@@ -0,0 +1,244 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace profiling {
+
+// A timed run of a phase of the program. name must be a string literal (or live as long as the
+// profiler), start is in nanoseconds since the profiler was created.
+struct Sample {
+	const char* name;
+	std::uint64_t start;
+	std::uint64_t duration;
+	std::uint32_t thread;
+};
+
+// Time spent in a phase during a frame and the number of times it ran.
+struct PhaseTotal {
+	const char* name;
+	unsigned int calls;
+	double milliseconds;
+};
+
+// Collects the samples of scoped timers (see PROFILE_SCOPE) and, at the end of every frame, sums
+// them per phase and writes them to the outputs that are open: a CSV file with one row per phase
+// and frame and a Chrome trace event file (chrome://tracing, Perfetto) with every sample. Each
+// thread records into its own buffer, so timers only contend when a frame ends. While disabled,
+// which is the default, a timer costs a single load and branch.
+class Profiler {
+public:
+	// Returns the profiler of the program.
+	static Profiler& instance(){
+		static Profiler profiler;
+		return profiler;
+	}
+
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+
+	~Profiler(){
+		close();
+	}
+
+	bool enabled() const {
+		return enabled_.load(std::memory_order_relaxed);
+	}
+
+	// Starts or stops recording samples. Opening an output enables the profiler.
+	void set_enabled(bool enabled){
+		enabled_.store(enabled, std::memory_order_relaxed);
+	}
+
+	// Returns true if a CSV or trace file is open.
+	bool has_outputs() const {
+		return csv_.is_open() || trace_.is_open();
+	}
+
+	// Writes the totals of every frame to a CSV file at path with the columns frame, phase, calls
+	// and milliseconds.
+	// Throws std::runtime_error if the file can not be created.
+	void open_csv(const std::string& path){
+		csv_.open(path, std::ios::trunc);
+		if(!csv_){
+			throw std::runtime_error("Could not create profile " + path);
+		}
+		csv_ << "frame,phase,calls,milliseconds\n";
+		set_enabled(true);
+	}
+
+	// Writes every sample to a Chrome trace event file at path.
+	// Throws std::runtime_error if the file can not be created.
+	void open_trace(const std::string& path){
+		trace_.open(path, std::ios::trunc);
+		if(!trace_){
+			throw std::runtime_error("Could not create trace " + path);
+		}
+		trace_ << "{\"traceEvents\":[\n";
+		trace_empty_ = true;
+		set_enabled(true);
+	}
+
+	// Finishes and closes the outputs.
+	void close(){
+		if(trace_.is_open()){
+			trace_ << "\n]}\n";
+			trace_.close();
+		}
+		if(csv_.is_open()){
+			csv_.close();
+		}
+	}
+
+	// Returns the current time in nanoseconds since the profiler was created.
+	std::uint64_t now() const {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch_).count();
+	}
+
+	// Records a run of the named phase on the calling thread.
+	void record(const char* name, std::uint64_t start, std::uint64_t end){
+		ThreadBuffer& buffer = thread_buffer();
+		std::lock_guard<std::mutex> lock(buffer.mutex);
+		buffer.samples.push_back(Sample{name, start, end - start, buffer.thread});
+	}
+
+	// Collects the samples recorded on every thread since the last frame ended, sums them per
+	// phase (see last_frame) and writes them to the open outputs.
+	void end_frame(){
+		samples_.clear();
+		{
+			std::lock_guard<std::mutex> lock(registry_mutex_);
+			for(const std::shared_ptr<ThreadBuffer>& buffer : buffers_){
+				std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+				samples_.insert(samples_.end(), buffer->samples.begin(), buffer->samples.end());
+				buffer->samples.clear();
+			}
+		}
+
+		// phases are listed in the order they first ran
+		frame_.clear();
+		for(const Sample& sample : samples_){
+			PhaseTotal* total = nullptr;
+			for(PhaseTotal& phase : frame_){
+				if(phase.name == sample.name || std::strcmp(phase.name, sample.name) == 0){
+					total = &phase;
+					break;
+				}
+			}
+			if(!total){
+				frame_.push_back(PhaseTotal{sample.name, 0, 0});
+				total = &frame_.back();
+			}
+			++total->calls;
+			total->milliseconds += sample.duration * 1e-6;
+		}
+
+		if(csv_.is_open()){
+			for(const PhaseTotal& phase : frame_){
+				csv_ << frame_index_ << ',' << phase.name << ',' << phase.calls << ',' << phase.milliseconds << '\n';
+			}
+		}
+		if(trace_.is_open()){
+			for(const Sample& sample : samples_){
+				trace_ << (trace_empty_ ? "" : ",\n")
+					<< "{\"name\":\"" << sample.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << sample.thread
+					<< ",\"ts\":" << sample.start / 1000.0 << ",\"dur\":" << sample.duration / 1000.0 << '}';
+				trace_empty_ = false;
+			}
+		}
+		++frame_index_;
+	}
+
+	// Returns the time spent in each phase during the last frame.
+	const std::vector<PhaseTotal>& last_frame() const {
+		return frame_;
+	}
+
+private:
+	// Samples recorded by one thread.
+	struct ThreadBuffer {
+		std::mutex mutex;
+		std::vector<Sample> samples;
+		std::uint32_t thread;
+	};
+
+	Profiler() :
+		enabled_(false),
+		epoch_(std::chrono::steady_clock::now()),
+		frame_index_(0),
+		trace_empty_(true)
+	{}
+
+	// Returns the buffer of the calling thread, registering it on first use. The buffer is shared
+	// with the registry so samples of threads that have exited are still collected.
+	ThreadBuffer& thread_buffer(){
+		thread_local std::shared_ptr<ThreadBuffer> buffer;
+		if(!buffer){
+			buffer = std::make_shared<ThreadBuffer>();
+			std::lock_guard<std::mutex> lock(registry_mutex_);
+			buffer->thread = static_cast<std::uint32_t>(buffers_.size());
+			buffers_.push_back(buffer);
+		}
+		return *buffer;
+	}
+
+	std::atomic<bool> enabled_;
+	std::chrono::steady_clock::time_point epoch_;
+
+	std::mutex registry_mutex_;
+	std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
+
+	// samples and totals of the last frame, kept to reuse their memory
+	std::vector<Sample> samples_;
+	std::vector<PhaseTotal> frame_;
+	unsigned long frame_index_;
+
+	std::ofstream csv_;
+	std::ofstream trace_;
+	bool trace_empty_;
+};
+
+// Records the time from its construction to its destruction as a run of the named phase if the
+// profiler is enabled when it is constructed.
+class ScopedTimer {
+public:
+	explicit ScopedTimer(const char* name) :
+		name_(Profiler::instance().enabled() ? name : nullptr),
+		start_(name_ ? Profiler::instance().now() : 0)
+	{}
+
+	ScopedTimer(const ScopedTimer&) = delete;
+	ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+	~ScopedTimer(){
+		if(name_){
+			Profiler& profiler = Profiler::instance();
+			profiler.record(name_, start_, profiler.now());
+		}
+	}
+
+private:
+	const char* name_;
+	std::uint64_t start_;
+};
+
+}
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// Times the rest of the enclosing scope as a run of the named phase. Compiled out entirely when
+// DISABLE_PROFILING is defined.
+#ifdef DISABLE_PROFILING
+#define PROFILE_SCOPE(name)
+#else
+#define PROFILE_SCOPE(name) profiling::ScopedTimer PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#endif
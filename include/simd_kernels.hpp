@@ -0,0 +1,283 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PHYSICS_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace physics::simd {
+
+// Instruction sets the kernels can be run with.
+enum class Level {
+	SCALAR,
+	SSE41,
+	AVX2
+};
+
+inline const char* level_name(Level level){
+	switch(level){
+		case Level::AVX2:   return "avx2";
+		case Level::SSE41:  return "sse4.1";
+		default:            return "scalar";
+	}
+}
+
+// Returns the best instruction set supported by the CPU the program is running on.
+inline Level detect_level(){
+#ifdef PHYSICS_SIMD_X86
+	if(__builtin_cpu_supports("avx2")){
+		return Level::AVX2;
+	}
+	if(__builtin_cpu_supports("sse4.1")){
+		return Level::SSE41;
+	}
+#endif
+	return Level::SCALAR;
+}
+
+// Returns the instruction set used by the kernels. It is detected on first use and may be lowered
+// (eg: to compare the kernels in benchmarks) but must not be raised above what the CPU supports.
+inline Level& active_level(){
+	static Level level = detect_level();
+	return level;
+}
+
+// Parameters of a particle step: the motion of the ground, the displacement due to gravity over
+// the timestep (a * dt * dt), the ratio of the timestep to the previous one by which the motion of
+// the previous step is scaled (1 for a constant timestep) and the bounds of the system after the
+// ground has moved.
+template <class T> struct StepParams {
+	T ground_dx;
+	T ground_dy;
+	T ax;
+	T ay;
+	T velocity_scale;
+	T xmin;
+	T xmax;
+	T ymin;
+	T ymax;
+};
+
+// Moves the particles in [0, n) by one step in a single pass. When Shake is true, fixed particles
+// are moved with the ground and placed on it and free particles touching the ground are moved
+// with it, as EarthquakeSystem::update does. Then free particles are integrated using
+// time corrected Verlet Integration and every particle is clamped to the bounds. Asleep particles are not
+// integrated, they are moved by the ground like the others as the caller wakes them first.
+template <bool Shake, class T> void step_scalar(T* x, T* y, T* px, T* py, const unsigned char* fixed, const unsigned char* asleep, std::size_t n, const StepParams<T>& p){
+	for(std::size_t i = 0; i < n; ++i){
+		if constexpr(Shake){
+			if(fixed[i]){
+				x[i] = x[i] + p.ground_dx;
+				y[i] = p.ymin;
+			}
+			else if(y[i] <= p.ymin){
+				x[i] += p.ground_dx;
+				y[i] += p.ground_dy;
+				if(x[i] < p.xmin)       x[i] = p.xmin;
+				else if(x[i] > p.xmax)  x[i] = p.xmax;
+				if(y[i] < p.ymin)       y[i] = p.ymin;
+				else if(y[i] > p.ymax)  y[i] = p.ymax;
+			}
+		}
+
+		if(!fixed[i] && !asleep[i]){
+			T cx = x[i];
+			T cy = y[i];
+			x[i] += (cx - px[i]) * p.velocity_scale + p.ax;
+			y[i] += (cy - py[i]) * p.velocity_scale + p.ay;
+			px[i] = cx;
+			py[i] = cy;
+		}
+
+		if(x[i] < p.xmin)       x[i] = p.xmin;
+		else if(x[i] > p.xmax)  x[i] = p.xmax;
+		if(y[i] < p.ymin)       y[i] = p.ymin;
+		else if(y[i] > p.ymax)  y[i] = p.ymax;
+	}
+}
+
+// Clamps the particles in [0, n) to the given bounds.
+template <class T> void clamp_scalar(T* x, T* y, std::size_t n, T xmin, T xmax, T ymin, T ymax){
+	for(std::size_t i = 0; i < n; ++i){
+		if(x[i] < xmin)         x[i] = xmin;
+		else if(x[i] > xmax)    x[i] = xmax;
+		if(y[i] < ymin)         y[i] = ymin;
+		else if(y[i] > ymax)    y[i] = ymax;
+	}
+}
+
+#ifdef PHYSICS_SIMD_X86
+
+// The vector kernels compute exactly what the scalar ones do, lane by lane. Clamping is written as
+// min(hi, max(lo, v)) because with that operand order NaNs pass through like they do in the
+// scalar comparisons. Both return the number of particles processed, the caller finishes the
+// remainder with the scalar kernels.
+
+template <bool Shake> __attribute__((target("avx2")))
+std::size_t step_avx2(float* x, float* y, float* px, float* py, const unsigned char* fixed, const unsigned char* asleep, std::size_t n, const StepParams<float>& p){
+	const __m256 gdx = _mm256_set1_ps(p.ground_dx);
+	const __m256 gdy = _mm256_set1_ps(p.ground_dy);
+	const __m256 ax = _mm256_set1_ps(p.ax);
+	const __m256 ay = _mm256_set1_ps(p.ay);
+	const __m256 scale = _mm256_set1_ps(p.velocity_scale);
+	const __m256 xmin = _mm256_set1_ps(p.xmin);
+	const __m256 xmax = _mm256_set1_ps(p.xmax);
+	const __m256 ymin = _mm256_set1_ps(p.ymin);
+	const __m256 ymax = _mm256_set1_ps(p.ymax);
+
+	std::size_t i = 0;
+	for(; i + 8 <= n; i += 8){
+		__m256 vx = _mm256_loadu_ps(x + i);
+		__m256 vy = _mm256_loadu_ps(y + i);
+		__m256 vpx = _mm256_loadu_ps(px + i);
+		__m256 vpy = _mm256_loadu_ps(py + i);
+		__m256i flags = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(fixed + i)));
+		__m256 is_fixed = _mm256_castsi256_ps(_mm256_cmpgt_epi32(flags, _mm256_setzero_si256()));
+		__m256i sleeping = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(asleep + i)));
+		__m256 is_static = _mm256_or_ps(is_fixed, _mm256_castsi256_ps(_mm256_cmpgt_epi32(sleeping, _mm256_setzero_si256())));
+
+		if constexpr(Shake){
+			__m256 on_ground = _mm256_andnot_ps(is_fixed, _mm256_cmp_ps(vy, ymin, _CMP_LE_OQ));
+			__m256 sx = _mm256_add_ps(vx, gdx);
+			__m256 sy = _mm256_add_ps(vy, gdy);
+			__m256 cx = _mm256_min_ps(xmax, _mm256_max_ps(xmin, sx));
+			__m256 cy = _mm256_min_ps(ymax, _mm256_max_ps(ymin, sy));
+			vx = _mm256_blendv_ps(vx, cx, on_ground);
+			vy = _mm256_blendv_ps(vy, cy, on_ground);
+			vx = _mm256_blendv_ps(vx, sx, is_fixed);
+			vy = _mm256_blendv_ps(vy, ymin, is_fixed);
+		}
+
+		__m256 nx = _mm256_add_ps(vx, _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(vx, vpx), scale), ax));
+		__m256 ny = _mm256_add_ps(vy, _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(vy, vpy), scale), ay));
+		vpx = _mm256_blendv_ps(vx, vpx, is_static);
+		vpy = _mm256_blendv_ps(vy, vpy, is_static);
+		vx = _mm256_blendv_ps(nx, vx, is_static);
+		vy = _mm256_blendv_ps(ny, vy, is_static);
+
+		_mm256_storeu_ps(x + i, _mm256_min_ps(xmax, _mm256_max_ps(xmin, vx)));
+		_mm256_storeu_ps(y + i, _mm256_min_ps(ymax, _mm256_max_ps(ymin, vy)));
+		_mm256_storeu_ps(px + i, vpx);
+		_mm256_storeu_ps(py + i, vpy);
+	}
+	return i;
+}
+
+template <bool Shake> __attribute__((target("sse4.1")))
+std::size_t step_sse41(float* x, float* y, float* px, float* py, const unsigned char* fixed, const unsigned char* asleep, std::size_t n, const StepParams<float>& p){
+	const __m128 gdx = _mm_set1_ps(p.ground_dx);
+	const __m128 gdy = _mm_set1_ps(p.ground_dy);
+	const __m128 ax = _mm_set1_ps(p.ax);
+	const __m128 ay = _mm_set1_ps(p.ay);
+	const __m128 scale = _mm_set1_ps(p.velocity_scale);
+	const __m128 xmin = _mm_set1_ps(p.xmin);
+	const __m128 xmax = _mm_set1_ps(p.xmax);
+	const __m128 ymin = _mm_set1_ps(p.ymin);
+	const __m128 ymax = _mm_set1_ps(p.ymax);
+
+	std::size_t i = 0;
+	for(; i + 4 <= n; i += 4){
+		__m128 vx = _mm_loadu_ps(x + i);
+		__m128 vy = _mm_loadu_ps(y + i);
+		__m128 vpx = _mm_loadu_ps(px + i);
+		__m128 vpy = _mm_loadu_ps(py + i);
+		int packed;
+		std::memcpy(&packed, fixed + i, sizeof(packed));
+		__m128i flags = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed));
+		__m128 is_fixed = _mm_castsi128_ps(_mm_cmpgt_epi32(flags, _mm_setzero_si128()));
+		std::memcpy(&packed, asleep + i, sizeof(packed));
+		__m128i sleeping = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed));
+		__m128 is_static = _mm_or_ps(is_fixed, _mm_castsi128_ps(_mm_cmpgt_epi32(sleeping, _mm_setzero_si128())));
+
+		if constexpr(Shake){
+			__m128 on_ground = _mm_andnot_ps(is_fixed, _mm_cmple_ps(vy, ymin));
+			__m128 sx = _mm_add_ps(vx, gdx);
+			__m128 sy = _mm_add_ps(vy, gdy);
+			__m128 cx = _mm_min_ps(xmax, _mm_max_ps(xmin, sx));
+			__m128 cy = _mm_min_ps(ymax, _mm_max_ps(ymin, sy));
+			vx = _mm_blendv_ps(vx, cx, on_ground);
+			vy = _mm_blendv_ps(vy, cy, on_ground);
+			vx = _mm_blendv_ps(vx, sx, is_fixed);
+			vy = _mm_blendv_ps(vy, ymin, is_fixed);
+		}
+
+		__m128 nx = _mm_add_ps(vx, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(vx, vpx), scale), ax));
+		__m128 ny = _mm_add_ps(vy, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(vy, vpy), scale), ay));
+		vpx = _mm_blendv_ps(vx, vpx, is_static);
+		vpy = _mm_blendv_ps(vy, vpy, is_static);
+		vx = _mm_blendv_ps(nx, vx, is_static);
+		vy = _mm_blendv_ps(ny, vy, is_static);
+
+		_mm_storeu_ps(x + i, _mm_min_ps(xmax, _mm_max_ps(xmin, vx)));
+		_mm_storeu_ps(y + i, _mm_min_ps(ymax, _mm_max_ps(ymin, vy)));
+		_mm_storeu_ps(px + i, vpx);
+		_mm_storeu_ps(py + i, vpy);
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+inline std::size_t clamp_avx2(float* x, float* y, std::size_t n, float lo_x, float hi_x, float lo_y, float hi_y){
+	const __m256 xmin = _mm256_set1_ps(lo_x);
+	const __m256 xmax = _mm256_set1_ps(hi_x);
+	const __m256 ymin = _mm256_set1_ps(lo_y);
+	const __m256 ymax = _mm256_set1_ps(hi_y);
+	std::size_t i = 0;
+	for(; i + 8 <= n; i += 8){
+		_mm256_storeu_ps(x + i, _mm256_min_ps(xmax, _mm256_max_ps(xmin, _mm256_loadu_ps(x + i))));
+		_mm256_storeu_ps(y + i, _mm256_min_ps(ymax, _mm256_max_ps(ymin, _mm256_loadu_ps(y + i))));
+	}
+	return i;
+}
+
+__attribute__((target("sse4.1")))
+inline std::size_t clamp_sse41(float* x, float* y, std::size_t n, float lo_x, float hi_x, float lo_y, float hi_y){
+	const __m128 xmin = _mm_set1_ps(lo_x);
+	const __m128 xmax = _mm_set1_ps(hi_x);
+	const __m128 ymin = _mm_set1_ps(lo_y);
+	const __m128 ymax = _mm_set1_ps(hi_y);
+	std::size_t i = 0;
+	for(; i + 4 <= n; i += 4){
+		_mm_storeu_ps(x + i, _mm_min_ps(xmax, _mm_max_ps(xmin, _mm_loadu_ps(x + i))));
+		_mm_storeu_ps(y + i, _mm_min_ps(ymax, _mm_max_ps(ymin, _mm_loadu_ps(y + i))));
+	}
+	return i;
+}
+
+#endif
+
+// Runs the particle step with the best kernel available for T and the active instruction set.
+template <bool Shake, class T> void step(T* x, T* y, T* px, T* py, const unsigned char* fixed, const unsigned char* asleep, std::size_t n, const StepParams<T>& p){
+	std::size_t done = 0;
+#ifdef PHYSICS_SIMD_X86
+	if constexpr(std::is_same_v<T, float>){
+		switch(active_level()){
+			case Level::AVX2:   done = step_avx2<Shake>(x, y, px, py, fixed, asleep, n, p); break;
+			case Level::SSE41:  done = step_sse41<Shake>(x, y, px, py, fixed, asleep, n, p); break;
+			default:            break;
+		}
+	}
+#endif
+	step_scalar<Shake>(x + done, y + done, px + done, py + done, fixed + done, asleep + done, n - done, p);
+}
+
+// Clamps the particles with the best kernel available for T and the active instruction set.
+template <class T> void clamp(T* x, T* y, std::size_t n, T xmin, T xmax, T ymin, T ymax){
+	std::size_t done = 0;
+#ifdef PHYSICS_SIMD_X86
+	if constexpr(std::is_same_v<T, float>){
+		switch(active_level()){
+			case Level::AVX2:   done = clamp_avx2(x, y, n, xmin, xmax, ymin, ymax); break;
+			case Level::SSE41:  done = clamp_sse41(x, y, n, xmin, xmax, ymin, ymax); break;
+			default:            break;
+		}
+	}
+#endif
+	clamp_scalar(x + done, y + done, n - done, xmin, xmax, ymin, ymax);
+}
+
+}
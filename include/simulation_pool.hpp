@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "earthquake_system.hpp"
+#include "thread_pool.hpp"
+
+namespace game {
+
+// Horizontal and vertical magnitude of an earthquake.
+using magnitudes_t = std::pair<unsigned int, unsigned int>;
+
+// Parses a comma separated list of magnitudes, each written as horizontal:vertical, eg: "1:1,3:2".
+// Throws std::invalid_argument if the list is malformed or a magnitude is out of bounds.
+inline std::vector<magnitudes_t> parse_magnitudes(const std::string& list){
+	std::vector<magnitudes_t> magnitudes;
+	std::size_t begin = 0;
+	while(begin <= list.size()){
+		std::size_t end = list.find(',', begin);
+		if(end == std::string::npos){
+			end = list.size();
+		}
+		std::string item = list.substr(begin, end - begin);
+		std::size_t colon = item.find(':');
+		std::size_t x_end = 0;
+		std::size_t y_end = 0;
+		unsigned long x = 0;
+		unsigned long y = 0;
+		try {
+			if(colon == std::string::npos || colon == 0 || colon + 1 == item.size()){
+				throw std::invalid_argument(item);
+			}
+			x = std::stoul(item.substr(0, colon), &x_end);
+			y = std::stoul(item.substr(colon + 1), &y_end);
+		} catch(const std::exception&){
+			throw std::invalid_argument("Magnitudes must be written as horizontal:vertical, got \"" + item + "\"");
+		}
+		if(x_end != colon || y_end != item.size() - colon - 1){
+			throw std::invalid_argument("Magnitudes must be written as horizontal:vertical, got \"" + item + "\"");
+		}
+		const unsigned long upper_bound = EarthquakeSystem<float>::MAGNITUDE_UPPER_BOUND;
+		if(x > upper_bound || y > upper_bound){
+			throw std::invalid_argument("Magnitude is out of bounds in \"" + item + "\"");
+		}
+		magnitudes.emplace_back(x, y);
+		begin = end + 1;
+	}
+	return magnitudes;
+}
+
+// A set of independent EarthquakeSystems stepped concurrently, each on a single thread of a
+// worker pool. The systems share nothing, so every one of them evolves exactly as it would on
+// its own, eg: to compare the same building under several earthquakes using every core.
+template <class T> class SimulationPool {
+public:
+	// Creates an empty pool stepping its systems on the given number of threads, including the
+	// calling thread.
+	explicit SimulationPool(unsigned int threads) :
+		pool_(threads)
+	{}
+
+	// Adds a system constructed from the given arguments and returns it.
+	template <class... Args> EarthquakeSystem<T>& add(Args&&... args){
+		systems_.push_back(std::make_unique<EarthquakeSystem<T>>(std::forward<Args>(args)...));
+		return *systems_.back();
+	}
+
+	std::size_t size() const {
+		return systems_.size();
+	}
+
+	EarthquakeSystem<T>& operator[](std::size_t i){
+		return *systems_[i];
+	}
+
+	// Calls fn(index, system) for every system, the systems being split across the threads of
+	// the pool. Calls for different systems may run concurrently. If calls throw, the exception
+	// of the first thread that threw is rethrown here once every thread has finished, the systems
+	// after the one that threw on the same thread being skipped.
+	template <class F> void for_each(F&& fn){
+		pool_.parallel_for(systems_.size(), [&](std::size_t begin, std::size_t end){
+			for(std::size_t i = begin; i < end; ++i){
+				fn(i, *systems_[i]);
+			}
+		});
+	}
+
+	// Updates every system by the given number of steps of dt.
+	// Rethrows an exception thrown by updating a system, eg: a read error of its AccelerogramMotion,
+	// see for_each.
+	void update(double dt, unsigned long steps = 1){
+		for_each([&](std::size_t, EarthquakeSystem<T>& system){
+			for(unsigned long step = 0; step < steps; ++step){
+				system.update(dt);
+			}
+		});
+	}
+
+	// Advances every system by duration in the steps chosen by its adaptive timestep, see
+	// EarthquakeSystem::advance.
+	void advance(double duration){
+		for_each([&](std::size_t, EarthquakeSystem<T>& system){
+			system.advance(duration);
+		});
+	}
+
+	// Resets every system for the next scene, see EarthquakeSystem::reset.
+	void reset(){
+		for_each([](std::size_t, EarthquakeSystem<T>& system){
+			system.reset();
+		});
+	}
+
+private:
+	physics::ThreadPool pool_;
+
+	// systems are never moved as views refer to their particle systems by address
+	std::vector<std::unique_ptr<EarthquakeSystem<T>>> systems_;
+};
+
+}
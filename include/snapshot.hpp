@@ -0,0 +1,203 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "earthquake_system.hpp"
+
+namespace game {
+
+// Header at the start of a snapshot file. It is followed by the particle_count x coordinates,
+// y coordinates, previous x coordinates and previous y coordinates of the particles, then the
+// joint_count joints as stored by the particle system (two particle indices and a rest length),
+// the particle_count quiet steps of the islands of the particles (32 bit integers) and last the
+// particle_count fixed and asleep flags, one byte each. Coordinates are of scalar_size bytes
+// and everything is in the byte order of the machine that wrote it. Every array starts at a
+// multiple of its alignment, so the arrays can be used straight from a mapping of the file.
+// The header also holds the timestep of the last step and the speed of the ground during it, so
+// a run resumed from a snapshot continues exactly as it would have, adaptive timestep included.
+struct SnapshotHeader {
+	char magic[4];
+	std::uint32_t version;
+	std::uint32_t scalar_size;
+	std::uint32_t particle_count;
+	std::uint32_t joint_count;
+	std::uint32_t magnitude_x;
+	std::uint32_t magnitude_y;
+	std::uint32_t reserved;
+	double run_time;
+	double ground_dx;
+	double xmin;
+	double ymin;
+	double xmax;
+	double ymax;
+	double last_timestep;
+	double ground_speed;
+};
+static_assert(sizeof(SnapshotHeader) == 96, "SnapshotHeader must match the file layout");
+
+constexpr char SNAPSHOT_MAGIC[4] = {'E', 'Q', 'S', 'S'};
+constexpr std::uint32_t SNAPSHOT_VERSION = 2;
+
+// Byte offsets of the arrays of a snapshot of n particles and j joints, and its total size.
+template <class T> struct SnapshotLayout {
+	std::size_t x, y, prev_x, prev_y, joints, quiet_steps, fixed, asleep, size;
+
+	SnapshotLayout(std::size_t n, std::size_t j){
+		x = sizeof(SnapshotHeader);
+		y = x + n * sizeof(T);
+		prev_x = y + n * sizeof(T);
+		prev_y = prev_x + n * sizeof(T);
+		joints = prev_y + n * sizeof(T);
+		quiet_steps = joints + j * sizeof(physics::JointConstraint<T>);
+		fixed = quiet_steps + n * sizeof(std::int32_t);
+		asleep = fixed + n;
+		size = asleep + n;
+	}
+};
+
+// Writes the complete state of the system (earthquake, bounds, particles, joints and sleep) to the file
+// at path. The snapshot is written to a temporary file first and then renamed, so an existing
+// snapshot is never left half overwritten.
+// Throws std::runtime_error if the file can not be written.
+template <class T> void save_snapshot(EarthquakeSystem<T>& system, const std::string& path){
+	static_assert(std::is_trivially_copyable_v<physics::JointConstraint<T>>);
+	physics::ParticleSystem<T>& particles = system.particle_system();
+	const auto& box = particles.bounding_box();
+
+	SnapshotHeader header{};
+	std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	header.version = SNAPSHOT_VERSION;
+	header.scalar_size = sizeof(T);
+	header.particle_count = static_cast<std::uint32_t>(particles.particle_count());
+	header.joint_count = static_cast<std::uint32_t>(particles.joint_count());
+	header.magnitude_x = system.magnitude_x();
+	header.magnitude_y = system.magnitude_y();
+	header.run_time = system.run_time();
+	header.ground_dx = system.ground_dx();
+	header.xmin = box.xmin();
+	header.ymin = box.ymin();
+	header.xmax = box.xmax();
+	header.ymax = box.ymax();
+	header.last_timestep = particles.last_timestep();
+	header.ground_speed = system.ground_speed();
+
+	std::vector<std::int32_t> quiet_steps(particles.particle_count());
+	for(std::size_t i = 0; i < quiet_steps.size(); ++i){
+		quiet_steps[i] = particles.quiet_steps(i);
+	}
+
+	std::string temporary = path + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		auto write = [&](const void* data, std::size_t size){
+			file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+		};
+		write(&header, sizeof(header));
+		for(std::span<const T> values : {particles.xs(), particles.ys(), particles.prev_xs(), particles.prev_ys()}){
+			write(values.data(), values.size_bytes());
+		}
+		write(particles.joint_constraints().data(), particles.joint_constraints().size_bytes());
+		write(quiet_steps.data(), quiet_steps.size() * sizeof(std::int32_t));
+		write(particles.fixed_flags().data(), particles.fixed_flags().size_bytes());
+		write(particles.asleep_flags().data(), particles.asleep_flags().size_bytes());
+		file.close();
+		if(!file){
+			std::filesystem::remove(temporary);
+			throw std::runtime_error("Could not write snapshot " + path);
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(temporary, path, error);
+	if(error){
+		std::filesystem::remove(temporary, error);
+		throw std::runtime_error("Could not write snapshot " + path);
+	}
+}
+
+// Replaces the state of the system with the snapshot in the file at path. The file is mapped into
+// memory and its arrays copied straight from the mapping. The system then continues as the one
+// saved would have, and handles given out before are invalidated.
+// Throws std::runtime_error if the file can not be read or is not a valid snapshot for T, the
+// system is unchanged then.
+template <class T> void load_snapshot(EarthquakeSystem<T>& system, const std::string& path){
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0){
+		throw std::runtime_error("Could not open snapshot " + path);
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(SnapshotHeader)){
+		close(fd);
+		throw std::runtime_error("Snapshot is too small " + path);
+	}
+	std::size_t size = st.st_size;
+	void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(mapping == MAP_FAILED){
+		throw std::runtime_error("Could not map snapshot " + path);
+	}
+	const char* data = static_cast<const char*>(mapping);
+
+	SnapshotHeader header;
+	std::memcpy(&header, data, sizeof(header));
+	SnapshotLayout<T> layout(header.particle_count, header.joint_count);
+	const char* problem = nullptr;
+	if(std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0){
+		problem = "Not a snapshot ";
+	}
+	else if(header.version != SNAPSHOT_VERSION){
+		problem = "Unsupported snapshot version ";
+	}
+	else if(header.scalar_size != sizeof(T)){
+		problem = "Snapshot was written with another precision ";
+	}
+	else if(size != layout.size){
+		problem = "Snapshot size does not match its header ";
+	}
+	else if(header.magnitude_x > EarthquakeSystem<T>::MAGNITUDE_UPPER_BOUND || header.magnitude_y > EarthquakeSystem<T>::MAGNITUDE_UPPER_BOUND){
+		problem = "Snapshot magnitude is out of bounds ";
+	}
+	if(problem){
+		munmap(mapping, size);
+		throw std::runtime_error(problem + path);
+	}
+
+	auto values = [&](std::size_t offset){
+		return std::span<const T>(reinterpret_cast<const T*>(data + offset), header.particle_count);
+	};
+	std::span<const physics::JointConstraint<T>> joints(
+		reinterpret_cast<const physics::JointConstraint<T>*>(data + layout.joints), header.joint_count);
+	std::span<const unsigned char> fixed(reinterpret_cast<const unsigned char*>(data + layout.fixed), header.particle_count);
+	std::span<const unsigned char> asleep(reinterpret_cast<const unsigned char*>(data + layout.asleep), header.particle_count);
+	std::span<const std::int32_t> quiet_steps(reinterpret_cast<const std::int32_t*>(data + layout.quiet_steps), header.particle_count);
+
+	physics::ParticleSystem<T>& particles = system.particle_system();
+	try {
+		particles.assign(values(layout.x), values(layout.y), values(layout.prev_x), values(layout.prev_y), fixed, joints);
+		particles.restore_history(T(header.last_timestep), asleep, quiet_steps);
+	} catch(const std::invalid_argument& e){
+		munmap(mapping, size);
+		throw std::runtime_error(std::string("Invalid snapshot ") + path + ": " + e.what());
+	}
+	munmap(mapping, size);
+
+	using Rectangle = typename physics::ParticleSystem<T>::Rectangle;
+	using Point = typename physics::ParticleSystem<T>::Point;
+	particles.bounding_box() = Rectangle(Point(T(header.xmin), T(header.ymin)), Point(T(header.xmax), T(header.ymax)));
+	system.restore(T(header.run_time), T(header.ground_dx), T(header.ground_speed), header.magnitude_x, header.magnitude_y);
+}
+
+}
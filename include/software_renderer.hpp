@@ -0,0 +1,279 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "earthquake_system.hpp"
+#include "profiler.hpp"
+#include "texture_file.hpp"
+
+namespace game {
+
+// An RGB image, 3 bytes per pixel with rows stored top to bottom and packed without padding.
+struct Framebuffer {
+	unsigned int width = 0;
+	unsigned int height = 0;
+	std::vector<std::uint8_t> pixels;
+
+	void resize(unsigned int w, unsigned int h){
+		width = w;
+		height = h;
+		pixels.resize(std::size_t(w) * h * 3);
+	}
+
+	std::uint8_t* row(unsigned int y){
+		return pixels.data() + std::size_t(y) * width * 3;
+	}
+
+	const std::uint8_t* row(unsigned int y) const {
+		return pixels.data() + std::size_t(y) * width * 3;
+	}
+};
+
+struct Color {
+	std::uint8_t r;
+	std::uint8_t g;
+	std::uint8_t b;
+};
+
+// Draws the scene of the windowed program (sky, shaking ground, particles, joints and the time and
+// magnitudes) into a Framebuffer on the CPU, without a display or an OpenGL context. The framebuffer
+// covers the bounds of the system one pixel per unit. Without textures the sky and the ground are
+// drawn in plain colours.
+class SoftwareRenderer {
+public:
+	// Loads the sky and ground textures of the windowed program from the given .texture files.
+	// Throws std::runtime_error if either cannot be read.
+	void load_textures(const std::string& sky_path, const std::string& ground_path){
+		sky_ = texture_utils::read_texture_image(sky_path);
+		ground_ = texture_utils::read_texture_image(ground_path);
+	}
+
+	// Draws the system into frame, resized to the bounds of the system, with timer drawn where the
+	// windowed program shows the time.
+	template <class T> void render(EarthquakeSystem<T>& system, const std::string& timer, Framebuffer& frame){
+		PROFILE_SCOPE("rasterize");
+		const auto& box = system.particle_system().bounding_box();
+		unsigned int width = static_cast<unsigned int>(std::max<T>(box.xmax(), 1));
+		unsigned int height = static_cast<unsigned int>(std::max<T>(box.ymax(), 1));
+		frame.resize(width, height);
+		float ground_height = static_cast<float>(system.ground_height());
+		float ground_dx = static_cast<float>(system.ground_dx());
+
+		if(sky_){
+			draw_image(frame, *sky_, 0, 0, float(width), float(height));
+		}
+		else {
+			fill(frame, 0, 0, float(width), float(height), SKY);
+		}
+		// the ground texture is stretched with the ground as in the windowed program
+		if(ground_){
+			draw_image(frame, *ground_, 0, 0, width + ground_dx + 100, ground_height);
+		}
+		else {
+			fill(frame, 0, 0, float(width), ground_height, GROUND);
+		}
+
+		std::span<const T> xs = system.particle_system().xs();
+		std::span<const T> ys = system.particle_system().ys();
+		for(std::size_t i = 0; i < xs.size(); ++i){
+			draw_point(frame, float(xs[i]), float(ys[i]), PARTICLE);
+		}
+		for(const physics::JointConstraint<T>& joint : system.particle_system().joint_constraints()){
+			draw_line(frame, float(xs[joint.p1]), float(ys[joint.p1]), float(xs[joint.p2]), float(ys[joint.p2]), JOINT);
+		}
+
+		int w = static_cast<int>(width);
+		int h = static_cast<int>(height);
+		draw_text(frame, w - 200, h - 40, timer, TEXT);
+		draw_text(frame, w - 280, h - 80, "Horiz. Shake: " + std::to_string(system.magnitude_x()), TEXT);
+		draw_text(frame, w - 267, h - 120, "Vert. Shake: " + std::to_string(system.magnitude_y()), TEXT);
+	}
+
+private:
+	static constexpr Color SKY = {135, 190, 235};
+	static constexpr Color GROUND = {150, 75, 50};
+	static constexpr Color PARTICLE = {255, 0, 0};
+	static constexpr Color JOINT = {0, 0, 255};
+	static constexpr Color TEXT = {255, 255, 255};
+
+	// Diameter of the particles, the point size of the windowed program
+	static constexpr float POINT_SIZE = 8;
+
+	// Glyphs of the characters from ' ' to 'Z', 5 columns of 7 pixels each, the lowest bit being
+	// the top row. Lower case letters are drawn as upper case ones, other characters as '?'.
+	static constexpr char FIRST_CHAR = ' ';
+	static constexpr char LAST_CHAR = 'Z';
+	static constexpr int GLYPH_SCALE = 2;
+	static constexpr std::array<std::array<std::uint8_t, 5>, LAST_CHAR - FIRST_CHAR + 1> GLYPHS = {{
+		{0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00}, {0x00, 0x07, 0x00, 0x07, 0x00}, // space ! "
+		{0x14, 0x7F, 0x14, 0x7F, 0x14}, {0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62}, // # $ %
+		{0x36, 0x49, 0x56, 0x20, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00}, {0x00, 0x1C, 0x22, 0x41, 0x00}, // & ' (
+		{0x00, 0x41, 0x22, 0x1C, 0x00}, {0x2A, 0x1C, 0x7F, 0x1C, 0x2A}, {0x08, 0x08, 0x3E, 0x08, 0x08}, // ) * +
+		{0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08}, {0x00, 0x60, 0x60, 0x00, 0x00}, // , - .
+		{0x20, 0x10, 0x08, 0x04, 0x02}, {0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00}, // / 0 1
+		{0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4B, 0x31}, {0x18, 0x14, 0x12, 0x7F, 0x10}, // 2 3 4
+		{0x27, 0x45, 0x45, 0x45, 0x39}, {0x3C, 0x4A, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03}, // 5 6 7
+		{0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1E}, {0x00, 0x36, 0x36, 0x00, 0x00}, // 8 9 :
+		{0x00, 0x56, 0x36, 0x00, 0x00}, {0x08, 0x14, 0x22, 0x41, 0x00}, {0x14, 0x14, 0x14, 0x14, 0x14}, // ; < =
+		{0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x51, 0x09, 0x06}, {0x3E, 0x41, 0x5D, 0x59, 0x4E}, // > ? @
+		{0x7E, 0x11, 0x11, 0x11, 0x7E}, {0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22}, // A B C
+		{0x7F, 0x41, 0x41, 0x22, 0x1C}, {0x7F, 0x49, 0x49, 0x49, 0x41}, {0x7F, 0x09, 0x09, 0x01, 0x01}, // D E F
+		{0x3E, 0x41, 0x41, 0x51, 0x32}, {0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00}, // G H I
+		{0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41}, {0x7F, 0x40, 0x40, 0x40, 0x40}, // J K L
+		{0x7F, 0x02, 0x04, 0x02, 0x7F}, {0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E}, // M N O
+		{0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E}, {0x7F, 0x09, 0x19, 0x29, 0x46}, // P Q R
+		{0x46, 0x49, 0x49, 0x49, 0x31}, {0x01, 0x01, 0x7F, 0x01, 0x01}, {0x3F, 0x40, 0x40, 0x40, 0x3F}, // S T U
+		{0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x7F, 0x20, 0x18, 0x20, 0x7F}, {0x63, 0x14, 0x08, 0x14, 0x63}, // V W X
+		{0x03, 0x04, 0x78, 0x04, 0x03}, {0x61, 0x51, 0x49, 0x45, 0x43}                                  // Y Z
+	}};
+
+	// Blends color over the pixel in column x and row y (from the top) with the given opacity.
+	static void blend(Framebuffer& frame, int x, int y, Color color, float alpha = 1){
+		std::uint8_t* pixel = frame.row(y) + 3 * x;
+		pixel[0] = static_cast<std::uint8_t>(pixel[0] + alpha * (color.r - pixel[0]) + 0.5f);
+		pixel[1] = static_cast<std::uint8_t>(pixel[1] + alpha * (color.g - pixel[1]) + 0.5f);
+		pixel[2] = static_cast<std::uint8_t>(pixel[2] + alpha * (color.b - pixel[2]) + 0.5f);
+	}
+
+	// Returns the columns or rows of pixels whose centers are in [lo, hi), clipped to [0, size).
+	static std::pair<int, int> pixel_span(float lo, float hi, unsigned int size){
+		int first = static_cast<int>(std::ceil(std::max(lo - 0.5f, 0.f)));
+		int last = static_cast<int>(std::ceil(std::min(hi - 0.5f, float(size))));
+		return {first, std::max(first, last)};
+	}
+
+	// Fills the box from (x0, y0) to (x1, y1) in world coordinates, y pointing up.
+	static void fill(Framebuffer& frame, float x0, float y0, float x1, float y1, Color color){
+		auto [first_column, last_column] = pixel_span(x0, x1, frame.width);
+		auto [first_row, last_row] = pixel_span(frame.height - y1, frame.height - y0, frame.height);
+		for(int y = first_row; y < last_row; ++y){
+			for(int x = first_column; x < last_column; ++x){
+				blend(frame, x, y, color);
+			}
+		}
+	}
+
+	// Draws the image stretched over the box from (x0, y0) to (x1, y1) in world coordinates, its top
+	// row along y1, filtered bilinearly like the textures of the windowed program.
+	static void draw_image(Framebuffer& frame, const texture_utils::image_t& image, float x0, float y0, float x1, float y1){
+		if(x1 <= x0 || y1 <= y0){
+			return;
+		}
+		auto [first_column, last_column] = pixel_span(x0, x1, frame.width);
+		auto [first_row, last_row] = pixel_span(frame.height - y1, frame.height - y0, frame.height);
+		float scale_x = image.width / (x1 - x0);
+		float scale_y = image.height / (y1 - y0);
+		float top = frame.height - y1;
+		int max_u = static_cast<int>(image.width) - 1;
+		int max_v = static_cast<int>(image.height) - 1;
+		unsigned int channels = image.channels;
+		for(int y = first_row; y < last_row; ++y){
+			float v = (y + 0.5f - top) * scale_y - 0.5f;
+			int v0 = std::clamp(static_cast<int>(std::floor(v)), 0, max_v);
+			int v1 = std::min(v0 + 1, max_v);
+			float fv = std::clamp(v - v0, 0.f, 1.f);
+			const unsigned char* row0 = image.pixels.data() + std::size_t(v0) * image.width * channels;
+			const unsigned char* row1 = image.pixels.data() + std::size_t(v1) * image.width * channels;
+			for(int x = first_column; x < last_column; ++x){
+				float u = (x + 0.5f - x0) * scale_x - 0.5f;
+				int u0 = std::clamp(static_cast<int>(std::floor(u)), 0, max_u);
+				int u1 = std::min(u0 + 1, max_u);
+				float fu = std::clamp(u - u0, 0.f, 1.f);
+				float texel[4] = {};
+				for(unsigned int c = 0; c < channels; ++c){
+					float top_value = row0[u0 * channels + c] + fu * (row0[u1 * channels + c] - row0[u0 * channels + c]);
+					float bottom_value = row1[u0 * channels + c] + fu * (row1[u1 * channels + c] - row1[u0 * channels + c]);
+					texel[c] = top_value + fv * (bottom_value - top_value);
+				}
+				Color color = {static_cast<std::uint8_t>(texel[0] + 0.5f), static_cast<std::uint8_t>(texel[1] + 0.5f),
+					static_cast<std::uint8_t>(texel[2] + 0.5f)};
+				blend(frame, x, y, color, channels == 4 ? texel[3] / 255 : 1);
+			}
+		}
+	}
+
+	// Draws a round point of diameter POINT_SIZE centered on (x, y) in world coordinates, its edge
+	// antialiased over a pixel.
+	static void draw_point(Framebuffer& frame, float x, float y, Color color){
+		float radius = POINT_SIZE / 2;
+		float center_y = frame.height - y;
+		auto [first_column, last_column] = pixel_span(x - radius - 0.5f, x + radius + 0.5f, frame.width);
+		auto [first_row, last_row] = pixel_span(center_y - radius - 0.5f, center_y + radius + 0.5f, frame.height);
+		for(int row = first_row; row < last_row; ++row){
+			float dy = row + 0.5f - center_y;
+			for(int column = first_column; column < last_column; ++column){
+				float dx = column + 0.5f - x;
+				float coverage = std::clamp(radius + 0.5f - std::sqrt(dx * dx + dy * dy), 0.f, 1.f);
+				if(coverage > 0){
+					blend(frame, column, row, color, coverage);
+				}
+			}
+		}
+	}
+
+	// Draws a one pixel wide line from (x0, y0) to (x1, y1) in world coordinates, stepping along its
+	// major axis like the aliased lines of the windowed program.
+	static void draw_line(Framebuffer& frame, float x0, float y0, float x1, float y1, Color color){
+		// pixel coordinates, y pointing down
+		float px0 = x0 - 0.5f;
+		float py0 = frame.height - y0 - 0.5f;
+		float px1 = x1 - 0.5f;
+		float py1 = frame.height - y1 - 0.5f;
+		float dx = px1 - px0;
+		float dy = py1 - py0;
+		int steps = static_cast<int>(std::ceil(std::max(std::abs(dx), std::abs(dy))));
+		if(steps == 0){
+			steps = 1;
+		}
+		int w = static_cast<int>(frame.width);
+		int h = static_cast<int>(frame.height);
+		for(int i = 0; i <= steps; ++i){
+			float t = float(i) / steps;
+			int x = static_cast<int>(std::lround(px0 + t * dx));
+			int y = static_cast<int>(std::lround(py0 + t * dy));
+			if(x >= 0 && x < w && y >= 0 && y < h){
+				blend(frame, x, y, color);
+			}
+		}
+	}
+
+	// Draws text with its lower left corner at (x, y) in world coordinates.
+	static void draw_text(Framebuffer& frame, int x, int y, const std::string& text, Color color){
+		int w = static_cast<int>(frame.width);
+		int h = static_cast<int>(frame.height);
+		// row of the top of the glyphs
+		int top = h - y - 7 * GLYPH_SCALE;
+		for(char c : text){
+			if(c >= 'a' && c <= 'z'){
+				c = static_cast<char>(c - 'a' + 'A');
+			}
+			if(c < FIRST_CHAR || c > LAST_CHAR){
+				c = '?';
+			}
+			const std::array<std::uint8_t, 5>& glyph = GLYPHS[c - FIRST_CHAR];
+			for(int column = 0; column < 5 * GLYPH_SCALE; ++column){
+				for(int row = 0; row < 7 * GLYPH_SCALE; ++row){
+					int px = x + column;
+					int py = top + row;
+					if((glyph[column / GLYPH_SCALE] >> (row / GLYPH_SCALE) & 1) && px >= 0 && px < w && py >= 0 && py < h){
+						blend(frame, px, py, color);
+					}
+				}
+			}
+			x += 6 * GLYPH_SCALE;
+		}
+	}
+
+	std::optional<texture_utils::image_t> sky_;
+	std::optional<texture_utils::image_t> ground_;
+};
+
+}
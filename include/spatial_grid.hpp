@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace physics {
+
+// A uniform grid over the plane used to find particles by position in O(1) expected time. Cells
+// are square and hashed into a table of buckets, so the grid has no bounds and its memory is
+// proportional to the number of entries rather than to the area covered.
+// The grid only stores indices, a bucket may contain particles of several cells so callers must
+// check the actual position of every candidate they are given.
+template <class T> class SpatialGrid {
+public:
+	explicit SpatialGrid(T cell_size) :
+		cell_size_(cell_size),
+		size_(0),
+		buckets_(MIN_BUCKETS)
+	{}
+
+	// Adds the entry with the given index at the given position.
+	void insert(std::uint32_t index, T x, T y){
+		buckets_[bucket(cell(x), cell(y))].push_back(index);
+		++size_;
+	}
+
+	// Returns true if the grid holds so many entries that it should be rebuilt with more buckets.
+	bool overloaded() const {
+		return size_ > 2 * buckets_.size();
+	}
+
+	// Rebuilds the grid from the positions of n entries, where entry i is at (xs[i], ys[i]).
+	// The number of buckets is grown with the number of entries, the memory of the buckets is
+	// reused otherwise.
+	void rebuild(const T* xs, const T* ys, std::size_t n){
+		std::size_t buckets = MIN_BUCKETS;
+		while(buckets < n){
+			buckets *= 2;
+		}
+		if(buckets > buckets_.size()){
+			buckets_.resize(buckets);
+		}
+		for(auto& b : buckets_){
+			b.clear();
+		}
+		size_ = 0;
+		for(std::size_t i = 0; i < n; ++i){
+			insert(static_cast<std::uint32_t>(i), xs[i], ys[i]);
+		}
+	}
+
+	// Calls visit(index) for every entry in a cell overlapping the given rectangle. Every entry
+	// is visited at most once but entries outside the rectangle may be visited too.
+	template <class F> void query(T xmin, T ymin, T xmax, T ymax, F&& visit) const {
+		long cx_min = cell(xmin);
+		long cx_max = cell(xmax);
+		long cy_min = cell(ymin);
+		long cy_max = cell(ymax);
+
+		// large areas are cheaper to scan in full than cell by cell
+		double cells = double(cx_max - cx_min + 1) * double(cy_max - cy_min + 1);
+		if(cells >= buckets_.size()){
+			for(const auto& b : buckets_){
+				for(std::uint32_t index : b){
+					visit(index);
+				}
+			}
+			return;
+		}
+
+		// several cells may share a bucket, make sure each bucket is visited once
+		std::vector<std::size_t>& visited = visited_;
+		visited.clear();
+		for(long cx = cx_min; cx <= cx_max; ++cx){
+			for(long cy = cy_min; cy <= cy_max; ++cy){
+				visited.push_back(bucket(cx, cy));
+			}
+		}
+		if(visited.size() > 1){
+			std::sort(visited.begin(), visited.end());
+			visited.erase(std::unique(visited.begin(), visited.end()), visited.end());
+		}
+		for(std::size_t b : visited){
+			for(std::uint32_t index : buckets_[b]){
+				visit(index);
+			}
+		}
+	}
+
+	// Removes every entry from the grid, keeping its memory.
+	void clear(){
+		for(auto& b : buckets_){
+			b.clear();
+		}
+		size_ = 0;
+	}
+
+	T cell_size() const {
+		return cell_size_;
+	}
+
+private:
+	static constexpr std::size_t MIN_BUCKETS = 64;
+
+	long cell(T v) const {
+		return static_cast<long>(std::floor(v / cell_size_));
+	}
+
+	// Hashes a cell to a bucket. The number of buckets is always a power of two.
+	std::size_t bucket(long cx, long cy) const {
+		std::uint64_t h = static_cast<std::uint64_t>(cx) * 73856093u ^ static_cast<std::uint64_t>(cy) * 19349663u;
+		return static_cast<std::size_t>(h ^ (h >> 17)) & (buckets_.size() - 1);
+	}
+
+	// width and height of a cell
+	T cell_size_;
+
+	// number of entries in the grid
+	std::size_t size_;
+
+	// indices of the entries in each bucket
+	std::vector<std::vector<std::uint32_t>> buckets_;
+
+	// scratch space for queries, kept to avoid allocating on every query
+	mutable std::vector<std::size_t> visited_;
+};
+
+}
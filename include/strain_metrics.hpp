@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace physics {
+
+// Configures StrainMetrics. Strains are counted in a histogram of bins bins of their magnitude,
+// each bin_width wide, the last bin counting every larger strain too. A joint is damaged once the
+// magnitude of its strain has exceeded damage_threshold.
+template <class T> struct StrainConfig {
+	T bin_width = T(0.01);
+	unsigned int bins = 16;
+	T damage_threshold = T(0.1);
+};
+
+// The strains of the joints at a step: the largest and root mean square magnitudes, the number of
+// joints damaged so far and the histogram of the magnitudes.
+template <class T> struct StrainSummary {
+	T max = 0;
+	T rms = 0;
+	std::size_t damaged = 0;
+	std::vector<std::uint64_t> histogram;
+};
+
+// Keeps statistics of the strains of the joints of a ParticleSystem (see
+// ParticleSystem::strains) over a run, updated once per step in a single pass over the joints:
+// the largest and root mean square strain magnitude of every joint, a histogram of every strain
+// seen and the summary of the last step.
+template <class T> class StrainMetrics {
+public:
+	explicit StrainMetrics(const StrainConfig<T>& config = StrainConfig<T>{}) :
+		config_(config)
+	{
+		config_.bins = std::max(config_.bins, 1u);
+		histogram_.assign(config_.bins, 0);
+		last_.histogram.assign(config_.bins, 0);
+	}
+
+	// Adds the strains of a step, indexed like the joints. Joints not seen before start being
+	// tracked from this step on.
+	void update(std::span<const T> strains){
+		if(strains.size() < max_.size()){
+			// the joints were cleared
+			reset();
+		}
+		max_.resize(strains.size(), T(0));
+		sum_squares_.resize(strains.size(), 0);
+		first_step_.resize(strains.size(), steps_);
+
+		std::fill(last_.histogram.begin(), last_.histogram.end(), 0);
+		T step_max = 0;
+		double step_sum_squares = 0;
+		for(std::size_t j = 0; j < strains.size(); ++j){
+			T strain = std::abs(strains[j]);
+			if(strain > max_[j]){
+				if(max_[j] <= config_.damage_threshold && strain > config_.damage_threshold){
+					++damaged_;
+				}
+				max_[j] = strain;
+			}
+			double square = double(strain) * strain;
+			sum_squares_[j] += square;
+			step_sum_squares += square;
+			step_max = std::max(step_max, strain);
+			std::size_t bin = std::min(static_cast<std::size_t>(strain / config_.bin_width), std::size_t(config_.bins - 1));
+			++last_.histogram[bin];
+		}
+		for(unsigned int b = 0; b < config_.bins; ++b){
+			histogram_[b] += last_.histogram[b];
+		}
+		last_.max = step_max;
+		last_.rms = strains.empty() ? T(0) : T(std::sqrt(step_sum_squares / strains.size()));
+		last_.damaged = damaged_;
+		++steps_;
+	}
+
+	// Forgets every step added.
+	void reset(){
+		max_.clear();
+		sum_squares_.clear();
+		first_step_.clear();
+		std::fill(histogram_.begin(), histogram_.end(), 0);
+		std::fill(last_.histogram.begin(), last_.histogram.end(), 0);
+		last_.max = 0;
+		last_.rms = 0;
+		last_.damaged = 0;
+		damaged_ = 0;
+		steps_ = 0;
+	}
+
+	const StrainConfig<T>& config() const {
+		return config_;
+	}
+
+	// Returns the number of steps added.
+	std::uint64_t steps() const {
+		return steps_;
+	}
+
+	// Returns the summary of the last step added.
+	const StrainSummary<T>& last() const {
+		return last_;
+	}
+
+	// Returns the number of joints tracked.
+	std::size_t joint_count() const {
+		return max_.size();
+	}
+
+	// Returns the largest strain magnitude of the joint at the given index.
+	T max_strain(std::size_t joint) const {
+		return max_[joint];
+	}
+
+	// Returns the root mean square strain of the joint at the given index over the steps since it
+	// was first seen.
+	T rms_strain(std::size_t joint) const {
+		std::uint64_t samples = steps_ - first_step_[joint];
+		return samples == 0 ? T(0) : T(std::sqrt(sum_squares_[joint] / samples));
+	}
+
+	// Returns the number of joints damaged so far.
+	std::size_t damaged() const {
+		return damaged_;
+	}
+
+	// Returns the histogram of the strain magnitudes of every joint at every step.
+	std::span<const std::uint64_t> histogram() const {
+		return histogram_;
+	}
+
+private:
+	StrainConfig<T> config_;
+	std::vector<T> max_;
+	std::vector<double> sum_squares_;
+	std::vector<std::uint64_t> first_step_;
+	std::vector<std::uint64_t> histogram_;
+	StrainSummary<T> last_;
+	std::size_t damaged_ = 0;
+	std::uint64_t steps_ = 0;
+};
+
+// Writes the summary of every step to a CSV file with a row per step: the step, the simulated
+// time, the largest and root mean square strain magnitudes, the number of damaged joints and the
+// histogram of the magnitudes, each column of which is named after the lower bound of its bin.
+template <class T> class StrainLog {
+public:
+	// Opens the file at path and writes the header for metrics configured with config.
+	// Throws std::runtime_error if the file cannot be opened.
+	StrainLog(const std::string& path, const StrainConfig<T>& config) :
+		path_(path), file_(path, std::ios::trunc)
+	{
+		if(!file_){
+			throw std::runtime_error("Could not open strain log " + path);
+		}
+		file_ << "step,time,max,rms,damaged";
+		for(unsigned int b = 0; b < std::max(config.bins, 1u); ++b){
+			file_ << "," << b * config.bin_width;
+		}
+		file_ << "\n";
+	}
+
+	// Writes the summary of the given step.
+	// Throws std::runtime_error if it cannot be written.
+	void write(std::uint64_t step, double time, const StrainSummary<T>& summary){
+		file_ << step << "," << time << "," << summary.max << "," << summary.rms << "," << summary.damaged;
+		for(std::uint64_t count : summary.histogram){
+			file_ << "," << count;
+		}
+		file_ << "\n";
+		if(!file_){
+			throw std::runtime_error("Could not write strain log " + path_);
+		}
+	}
+
+private:
+	std::string path_;
+	std::ofstream file_;
+};
+
+}
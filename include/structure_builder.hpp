@@ -0,0 +1,242 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "earthquake_system.hpp"
+
+namespace game {
+
+// Collects the nodes and edges of a structure and creates them all at once in a system, with
+// storage reserved up front and in time linear in the size of the structure. Nodes are merged by
+// position, so structures can be described edge by edge from coordinates, as they are built by
+// hand, without creating duplicate particles.
+template <class T> class StructureBuilder {
+public:
+	// An edge between the nodes at the given indices.
+	using Edge = std::pair<std::uint32_t, std::uint32_t>;
+
+	void reserve(std::size_t nodes, std::size_t edges){
+		xs_.reserve(nodes);
+		ys_.reserve(nodes);
+		fixed_.reserve(nodes);
+		index_.reserve(nodes);
+		edges_.reserve(edges);
+	}
+
+	// Adds a node at the given position, or marks the node already there fixed if fixed is true,
+	// and returns its index.
+	std::uint32_t add_node(T x, T y, bool fixed = false){
+		// adding zero makes -0 and 0 the same key
+		auto [it, added] = index_.try_emplace(std::make_pair(x + T(0), y + T(0)), static_cast<std::uint32_t>(xs_.size()));
+		if(added){
+			xs_.push_back(x);
+			ys_.push_back(y);
+			fixed_.push_back(fixed);
+		}
+		else if(fixed){
+			fixed_[it->second] = true;
+		}
+		return it->second;
+	}
+
+	// Adds an edge between the nodes at the given indices.
+	// Throws std::invalid_argument if a node does not exist or both are the same.
+	void add_edge(std::uint32_t a, std::uint32_t b){
+		if(a >= xs_.size() || b >= xs_.size()){
+			throw std::invalid_argument("Edge refers to a node that does not exist.");
+		}
+		if(a == b){
+			throw std::invalid_argument("Edge cannot connect a node to itself.");
+		}
+		edges_.emplace_back(a, b);
+	}
+
+	// Adds an edge between the given positions, adding nodes at them first if there are none.
+	void add_edge(T x1, T y1, T x2, T y2){
+		std::uint32_t a = add_node(x1, y1);
+		std::uint32_t b = add_node(x2, y2);
+		add_edge(a, b);
+	}
+
+	std::size_t node_count() const {
+		return xs_.size();
+	}
+
+	std::size_t edge_count() const {
+		return edges_.size();
+	}
+
+	T x(std::size_t node) const {
+		return xs_[node];
+	}
+
+	T y(std::size_t node) const {
+		return ys_[node];
+	}
+
+	const std::vector<Edge>& edges() const {
+		return edges_;
+	}
+
+	void clear(){
+		xs_.clear();
+		ys_.clear();
+		fixed_.clear();
+		index_.clear();
+		edges_.clear();
+	}
+
+	// Appends the structure to the particle system: a particle for every node, in the order they
+	// were added, and a joint for every edge. Returns the index of the particle of the first node.
+	std::size_t build(physics::ParticleSystem<T>& system) const {
+		std::size_t first = system.particle_count();
+		std::vector<std::pair<std::uint32_t, std::uint32_t>> joints(edges_.size());
+		for(std::size_t e = 0; e < edges_.size(); ++e){
+			joints[e] = {static_cast<std::uint32_t>(first + edges_[e].first), static_cast<std::uint32_t>(first + edges_[e].second)};
+		}
+		system.append(xs_, ys_, fixed_, joints);
+		return first;
+	}
+
+	// Adds the structure to the earthquake system as if every edge was created with
+	// EarthquakeSystem::create_joint: nodes where a particle already exists are joined to it,
+	// nodes on the ground are fixed and edges whose ends are at the same position once clamped to
+	// the bounds of the system are left out.
+	void build(EarthquakeSystem<T>& system) const {
+		physics::ParticleSystem<T>& particles = system.particle_system();
+		T ground = system.ground_height();
+		const auto& box = particles.bounding_box();
+
+		// index in the system and position of every node
+		std::vector<std::uint32_t> indices(xs_.size());
+		std::vector<std::pair<T, T>> positions(xs_.size());
+		std::vector<T> xs;
+		std::vector<T> ys;
+		std::vector<unsigned char> fixed;
+		xs.reserve(xs_.size());
+		ys.reserve(xs_.size());
+		fixed.reserve(xs_.size());
+		std::size_t next = particles.particle_count();
+		for(std::size_t i = 0; i < xs_.size(); ++i){
+			if(std::optional<physics::Particle<T>> p = particles.particle_at(xs_[i], ys_[i])){
+				indices[i] = p->handle().index;
+				positions[i] = {p->x(), p->y()};
+				continue;
+			}
+			positions[i] = {std::min(std::max(xs_[i], box.xmin()), box.xmax()), std::min(std::max(ys_[i], box.ymin()), box.ymax())};
+			indices[i] = static_cast<std::uint32_t>(next++);
+			xs.push_back(xs_[i]);
+			ys.push_back(ys_[i]);
+			fixed.push_back(fixed_[i] || ys_[i] <= ground);
+		}
+
+		std::vector<std::pair<std::uint32_t, std::uint32_t>> joints;
+		joints.reserve(edges_.size());
+		for(const Edge& edge : edges_){
+			if(positions[edge.first] != positions[edge.second]){
+				joints.emplace_back(indices[edge.first], indices[edge.second]);
+			}
+		}
+		particles.append(xs, ys, fixed, joints);
+	}
+
+private:
+	struct PositionHash {
+		std::size_t operator()(const std::pair<T, T>& position) const {
+			std::size_t hx = std::hash<T>()(position.first);
+			std::size_t hy = std::hash<T>()(position.second);
+			return hx ^ (hy + 0x9e3779b97f4a7c15ull + (hx << 6) + (hx >> 2));
+		}
+	};
+
+	std::vector<T> xs_;
+	std::vector<T> ys_;
+	std::vector<unsigned char> fixed_;
+	std::unordered_map<std::pair<T, T>, std::uint32_t, PositionHash> index_;
+	std::vector<Edge> edges_;
+};
+
+// Adds a frame of storeys floors and bays bays whose lower left corner is at (x, y), with a
+// diagonal brace in every panel. Edges are added floor by floor from the left, each column
+// followed by the beam and brace to its right.
+template <class T> void add_braced_frame(StructureBuilder<T>& builder, T x, T y, unsigned int storeys, unsigned int bays,
+		T bay_width, T storey_height){
+	builder.reserve(builder.node_count() + (storeys + 1) * (bays + 1), builder.edge_count() + storeys * (3 * bays + 1));
+	for(unsigned int storey = 0; storey < storeys; ++storey){
+		T y0 = y + storey * storey_height;
+		T y1 = y0 + storey_height;
+		for(unsigned int bay = 0; bay <= bays; ++bay){
+			T x0 = x + bay * bay_width;
+			// column
+			builder.add_edge(x0, y0, x0, y1);
+			if(bay < bays){
+				// beam and brace
+				builder.add_edge(x0, y1, x0 + bay_width, y1);
+				builder.add_edge(x0, y0, x0 + bay_width, y1);
+			}
+		}
+	}
+}
+
+// Adds a Pratt truss of panels panels whose lower left corner is at (x, y): a bottom and a top
+// chord joined by verticals, with diagonals sloping down towards the middle of the span.
+template <class T> void add_truss(StructureBuilder<T>& builder, T x, T y, unsigned int panels, T panel_width, T height){
+	builder.reserve(builder.node_count() + 2 * (panels + 1), builder.edge_count() + 4 * panels + 1);
+	for(unsigned int panel = 0; panel <= panels; ++panel){
+		T x0 = x + panel * panel_width;
+		T x1 = x0 + panel_width;
+		// vertical
+		builder.add_edge(x0, y, x0, y + height);
+		if(panel < panels){
+			// chords
+			builder.add_edge(x0, y, x1, y);
+			builder.add_edge(x0, y + height, x1, y + height);
+			// diagonal
+			if(2 * panel < panels){
+				builder.add_edge(x0, y + height, x1, y);
+			}
+			else {
+				builder.add_edge(x0, y, x1, y + height);
+			}
+		}
+	}
+}
+
+// Adds a grid of columns by rows nodes spaced spacing apart whose lower left node is at (x, y),
+// every node joined to its right and upper neighbours and, if braced is true, to its upper right
+// neighbour. Nodes are added row by row from the bottom.
+template <class T> void add_grid(StructureBuilder<T>& builder, T x, T y, unsigned int columns, unsigned int rows, T spacing,
+		bool braced = true){
+	std::size_t first = builder.node_count();
+	builder.reserve(first + std::size_t(columns) * rows, builder.edge_count() + std::size_t(columns) * rows * (braced ? 3 : 2));
+	std::vector<std::uint32_t> nodes(std::size_t(columns) * rows);
+	for(unsigned int row = 0; row < rows; ++row){
+		for(unsigned int column = 0; column < columns; ++column){
+			nodes[std::size_t(row) * columns + column] = builder.add_node(x + column * spacing, y + row * spacing);
+		}
+	}
+	for(unsigned int row = 0; row < rows; ++row){
+		for(unsigned int column = 0; column < columns; ++column){
+			std::uint32_t node = nodes[std::size_t(row) * columns + column];
+			if(column > 0){
+				builder.add_edge(nodes[std::size_t(row) * columns + column - 1], node);
+			}
+			if(row > 0){
+				builder.add_edge(nodes[std::size_t(row - 1) * columns + column], node);
+			}
+			if(braced && row > 0 && column > 0){
+				builder.add_edge(nodes[std::size_t(row - 1) * columns + column - 1], node);
+			}
+		}
+	}
+}
+
+}
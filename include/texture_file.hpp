@@ -0,0 +1,112 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// The .texture file format and the resource directory, without OpenGL, so programs without a
+// window can read the textures too. See texture_utils.hpp for uploading them.
+namespace texture_utils {
+    // Header at the start of every .texture file. It is followed by the pixels of each mip level from
+    // the largest to the smallest, every level being half the size of the previous one rounded down
+    // (but at least 1) with rows stored top to bottom and packed without padding.
+    struct texture_header_t {
+        char magic[4];
+        std::uint32_t width;
+        std::uint32_t height;
+        std::uint16_t channels;
+        std::uint16_t mip_levels;
+    };
+    static_assert(sizeof(texture_header_t) == 16, "texture_header_t must match the file layout");
+
+    constexpr char TEXTURE_MAGIC[4] = {'E', 'Q', 'T', 'X'};
+
+    // The largest mip level of a texture in memory, rows stored top to bottom
+    struct image_t {
+        unsigned int width = 0;
+        unsigned int height = 0;
+        unsigned int channels = 0;
+        std::vector<unsigned char> pixels;
+    };
+
+    // Returns the path of the given file in the resource directory. The directory is, in order of
+    // preference, the one named by the EARTHQUAKE_RESOURCES environment variable, a resources directory
+    // next to or one up from the executable, or the one the program was built with.
+    inline std::string resource_path(const char *name) {
+        namespace fs = std::filesystem;
+        if (const char *dir = std::getenv("EARTHQUAKE_RESOURCES")) {
+            return (fs::path(dir) / name).string();
+        }
+
+        std::error_code error;
+        fs::path exe_dir = fs::read_symlink("/proc/self/exe", error).parent_path();
+        if (!error) {
+            for (fs::path dir : {exe_dir / "resources", exe_dir.parent_path() / "resources"}) {
+                if (fs::exists(dir / name, error)) {
+                    return (dir / name).string();
+                }
+            }
+        }
+#ifdef EARTHQUAKE_RESOURCE_DIR
+        if (fs::exists(fs::path(EARTHQUAKE_RESOURCE_DIR) / name, error)) {
+            return (fs::path(EARTHQUAKE_RESOURCE_DIR) / name).string();
+        }
+#endif
+        throw std::runtime_error(std::string("Could not find resource ") + name);
+    }
+
+    // Returns why a texture file of the given size starting with the given header is invalid, or
+    // null if it is valid and holds every level its header describes.
+    inline const char *texture_error(const texture_header_t& header, std::size_t size) {
+        std::size_t expected = sizeof(header);
+        std::uint32_t level_width = header.width;
+        std::uint32_t level_height = header.height;
+        for (unsigned int level = 0; level < header.mip_levels; ++level) {
+            expected += std::size_t(level_width) * level_height * header.channels;
+            level_width = std::max(level_width / 2, 1u);
+            level_height = std::max(level_height / 2, 1u);
+        }
+        if (std::memcmp(header.magic, TEXTURE_MAGIC, sizeof(TEXTURE_MAGIC)) != 0) {
+            return "Not a texture file ";
+        } else if (header.width == 0 || header.height == 0 || header.mip_levels == 0) {
+            return "Texture file has no pixels ";
+        } else if (header.channels != 3 && header.channels != 4) {
+            return "Texture file has an unsupported number of channels ";
+        } else if (size != expected) {
+            return "Texture file size does not match its header ";
+        }
+        return nullptr;
+    }
+
+    // Reads the largest mip level of a .texture file
+    inline image_t read_texture_image(const std::string& filename) {
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        if (!file) {
+            throw std::runtime_error("Could not open texture file " + filename);
+        }
+        std::size_t size = static_cast<std::size_t>(file.tellg());
+        texture_header_t header;
+        if (size < sizeof(header) || !file.seekg(0).read(reinterpret_cast<char*>(&header), sizeof(header))) {
+            throw std::runtime_error("Texture file is too small " + filename);
+        }
+        if (const char *error = texture_error(header, size)) {
+            throw std::runtime_error(error + filename);
+        }
+
+        image_t image;
+        image.width = header.width;
+        image.height = header.height;
+        image.channels = header.channels;
+        image.pixels.resize(std::size_t(header.width) * header.height * header.channels);
+        if (!file.read(reinterpret_cast<char*>(image.pixels.data()), image.pixels.size())) {
+            throw std::runtime_error("Could not read texture file " + filename);
+        }
+        return image;
+    }
+}
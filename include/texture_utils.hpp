@@ -1,6 +1,18 @@
+#pragma once
 #include <GL/glew.h>
 #include <GL/glu.h>
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "texture_file.hpp"
 
 namespace texture_utils {
     struct texture_info_t {
@@ -52,28 +64,55 @@ namespace texture_utils {
         glPopMatrix();
     }
 
-    // Load a texture from a file and return a texture_info_t
-    texture_info_t load_texture(const char *filename, int width = 0, int height = 0) {
-        unsigned int texture_id;
+    // Load a .texture file and return a texture_info_t
+    // The file is mapped into memory and its pixels uploaded straight from the mapping.
+    texture_info_t load_texture(const std::string& filename) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Could not open texture file " + filename);
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(texture_header_t)) {
+            close(fd);
+            throw std::runtime_error("Texture file is too small " + filename);
+        }
+        std::size_t size = st.st_size;
+        void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error("Could not map texture file " + filename);
+        }
+        const unsigned char *data = static_cast<const unsigned char*>(mapping);
 
-        // Read texture from disk
-        FILE *fp = fopen(filename, "r");
-        if (fp == NULL) {
-            throw std::runtime_error("Could not open texture file");
+        // Validate the header and that the file holds every level it describes
+        texture_header_t header;
+        std::memcpy(&header, data, sizeof(header));
+        if (const char *error = texture_error(header, size)) {
+            munmap(mapping, size);
+            throw std::runtime_error(error + filename);
         }
-        fseek(fp , 0 , SEEK_END);
-        int size = ftell(fp);
-        unsigned char *pixels = (unsigned char*)malloc(sizeof(unsigned char) * size);
-        rewind(fp);
-        fread(pixels, sizeof(unsigned char), size, fp);
-        fclose(fp);
 
-        if (!pixels) {
-            throw std::runtime_error("Failed to load texture");
+        GLenum format = header.channels == 4 ? GL_RGBA : GL_RGB;
+        unsigned int texture_id;
+        glGenTextures(1, &texture_id);
+        glBindTexture(GL_TEXTURE_2D, texture_id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, header.mip_levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.mip_levels - 1);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        const unsigned char *pixels = data + sizeof(header);
+        std::uint32_t level_width = header.width;
+        std::uint32_t level_height = header.height;
+        for (unsigned int level = 0; level < header.mip_levels; ++level) {
+            glTexImage2D(GL_TEXTURE_2D, level, format, level_width, level_height, 0, format, GL_UNSIGNED_BYTE, pixels);
+            pixels += std::size_t(level_width) * level_height * header.channels;
+            level_width = std::max(level_width / 2, 1u);
+            level_height = std::max(level_height / 2, 1u);
         }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
 
-        texture_id = create_texture(width, height, pixels, GL_RGB);
-        free(pixels);
-        return {texture_id, width, height};
+        munmap(mapping, size);
+        return {texture_id, header.width, header.height};
     }
-}
\ No newline at end of file
+}
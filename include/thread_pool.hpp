@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace physics {
+
+// A fixed set of worker threads used to split loops over many particles or joints. The work is
+// always partitioned the same way for a given number of threads, so results computed with a pool
+// are deterministic for a given thread count.
+class ThreadPool {
+public:
+	// Creates a pool that runs loops on the given number of threads, including the calling thread.
+	explicit ThreadPool(unsigned int threads) :
+		epoch_(0),
+		pending_(0),
+		stopping_(false),
+		job_(nullptr),
+		context_(nullptr),
+		n_(0)
+	{
+		errors_.resize(std::max(threads, 1u));
+		for(unsigned int i = 1; i < threads; ++i){
+			workers_.emplace_back(&ThreadPool::work, this, i);
+		}
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	~ThreadPool(){
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+		}
+		start_.notify_all();
+		for(auto& worker : workers_){
+			worker.join();
+		}
+	}
+
+	// Returns the number of threads loops are run on, including the calling thread.
+	unsigned int size() const {
+		return static_cast<unsigned int>(workers_.size()) + 1;
+	}
+
+	// Calls fn(begin, end) once for each of size() contiguous ranges partitioning [0, n) and
+	// returns once every call has finished. The calling thread runs the first range.
+	// Rethrows the exception thrown by the call for the first range that threw one, if any, once
+	// every call has finished.
+	template <class F> void parallel_for(std::size_t n, F&& fn){
+		parallel_for_ranges(n, [&fn](unsigned int, std::size_t begin, std::size_t end){
+			fn(begin, end);
+		});
+	}
+
+	// Like parallel_for but also passes the index of the range (in [0, size())) to fn, so each
+	// range can write partial results to its own slot, eg: to reduce them in a fixed order.
+	template <class F> void parallel_for_ranges(std::size_t n, F&& fn){
+		if(workers_.empty() || n < 2){
+			fn(0u, std::size_t(0), n);
+			return;
+		}
+
+		using Fn = std::remove_reference_t<F>;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			job_ = [](void* context, unsigned int range, std::size_t begin, std::size_t end){
+				(*static_cast<Fn*>(context))(range, begin, end);
+			};
+			context_ = const_cast<void*>(static_cast<const void*>(&fn));
+			n_ = n;
+			pending_ = static_cast<unsigned int>(workers_.size());
+			++epoch_;
+		}
+		start_.notify_all();
+
+		run_range(0);
+
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			done_.wait(lock, [this]{ return pending_ == 0; });
+		}
+		std::exception_ptr first;
+		for(std::exception_ptr& error : errors_){
+			if(error && !first){
+				first = error;
+			}
+			error = nullptr;
+		}
+		if(first){
+			std::rethrow_exception(first);
+		}
+	}
+
+private:
+	// Runs the part of the current job belonging to the given thread, keeping the exception it
+	// throws, if any, for the calling thread to rethrow.
+	void run_range(unsigned int thread){
+		std::size_t threads = size();
+		std::size_t begin = n_ * thread / threads;
+		std::size_t end = n_ * (thread + 1) / threads;
+		if(begin < end){
+			try {
+				job_(context_, thread, begin, end);
+			} catch(...){
+				errors_[thread] = std::current_exception();
+			}
+		}
+	}
+
+	void work(unsigned int thread){
+		std::uint64_t seen = 0;
+		while(true){
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				start_.wait(lock, [&]{ return stopping_ || epoch_ != seen; });
+				if(stopping_){
+					return;
+				}
+				seen = epoch_;
+			}
+
+			run_range(thread);
+
+			bool last;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				last = --pending_ == 0;
+			}
+			if(last){
+				done_.notify_one();
+			}
+		}
+	}
+
+	std::vector<std::thread> workers_;
+
+	std::mutex mutex_;
+	std::condition_variable start_;
+	std::condition_variable done_;
+
+	// incremented every time a job is started
+	std::uint64_t epoch_;
+
+	// number of workers that have not finished the current job
+	unsigned int pending_;
+
+	bool stopping_;
+
+	// current job, a call of job_(context_, range, begin, end) runs one range of it
+	void (*job_)(void*, unsigned int, std::size_t, std::size_t);
+	void* context_;
+
+	// size of the loop of the current job
+	std::size_t n_;
+
+	// exception thrown by the range of each thread in the current job, if any
+	std::vector<std::exception_ptr> errors_;
+};
+
+}
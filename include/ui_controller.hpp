@@ -1,24 +1,33 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <algorithm>
+#include <cmath>
 #include <GL/glew.h>
 #include <GL/glu.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
 #include <string>
 #include <exception>
-#include <list>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#include <CGAL/Cartesian.h>
 #include <CGAL/Iso_rectangle_2.h>
 #include <CGAL/Point_2.h>
 
+#include "camera.hpp"
+#include "earthquake_system.hpp"
 #include "font_controller.hpp"
-#include "particle.hpp"
-#include "joint.hpp"
+#include "particle_system.hpp"
 
 namespace game {
     #define PIXEL_FORMAT GL_RGB
-    #define WIDTH 640
+    #define WIDTH 640               // size of the window, the world may be larger
     #define HEIGHT 480
-    #define FPS 60
+    #define PHYSICS_RATE 60         // physics steps per second
+    #define MAX_STEPS_PER_FRAME 8   // most physics steps run between two frames
     #define INIT_GROUND_LEVEL 40
 
     enum class insertion_mode_t {
@@ -26,6 +35,16 @@ namespace game {
         JOINT
     };
 
+    // Positions of the particles at the previous physics step. Particles are drawn at
+    // previous + alpha * (current - previous), particles created since have no previous position
+    // and are drawn where they are.
+    struct interpolation_t {
+        std::span<const float> previous_x;
+        std::span<const float> previous_y;
+        float alpha;
+    };
+
+    // CGAL is only used for the hit tests of the buttons, the physics has its own plain types
     using Bbox = CGAL::Iso_rectangle_2<CGAL::Cartesian<float>>;
     using Point = CGAL::Point_2<CGAL::Cartesian<float>>;
 
@@ -42,6 +61,9 @@ namespace game {
             Bbox vertical_mag_up_bbox;
             Bbox vertical_mag_down_bbox;
 
+            // True if the time spent in each phase of the last frame is drawn
+            bool show_profile = false;
+
             UIController(): window(nullptr),
                             start_bbox(Point(WIDTH-55, HEIGHT-40), Point(WIDTH-40, HEIGHT-10)),
                             stop_bbox(Point(WIDTH-30, HEIGHT-38), Point(WIDTH-5, HEIGHT-12)),
@@ -52,180 +74,213 @@ namespace game {
                 try {
                     initGLFW();
                     // Load ground and sky textures
-                    // Try different folders
-                    try {
-                        ground_texture_info = texture_utils::load_texture("../resources/brick.texture", 480, 200);
-                        sky_texture_info = texture_utils::load_texture("../resources/sky.texture", 640, 480);
-                    } catch(...) {
-                        ground_texture_info = texture_utils::load_texture("resources/brick.texture", 480, 200);
-                        sky_texture_info = texture_utils::load_texture("resources/sky.texture", 640, 480);
-                    }
-                    
-
-
+                    ground_texture_info = texture_utils::load_texture(texture_utils::resource_path("brick.texture"));
+                    sky_texture_info = texture_utils::load_texture(texture_utils::resource_path("sky.texture"));
                 } catch (std::exception& e) {
-                    throw std::runtime_error("Failed to initialize OpenGL");
+                    throw std::runtime_error(std::string("Failed to initialize OpenGL: ") + e.what());
                 }
             }
 
             ~UIController() {
+                glDeleteBuffers(1, &particle_buffer);
+                glDeleteBuffers(1, &joint_index_buffer);
                 glfwTerminate();
             }
 
-            void render(std::list<physics::Particle<float>> particles, 
-                        std::list<physics::Joint<float>> joints, 
+            // Draws the part of the world seen by camera, then the menu over it. Only the particles
+            // and joints in view are sent to the GPU.
+            void render(physics::ParticleSystem<float>& system,
+                        const Camera& camera,
+                        const interpolation_t& interpolation,
                         bool running, 
                         insertion_mode_t insertion_mode,
-                        physics::Particle<float>* selected_particle,
+                        std::optional<physics::Particle<float>> selected_particle,
                         unsigned int horizontal_magnitude,
                         unsigned int vertical_magnitude,
                         float ground_height,
                         float ground_dx,
                         std::string timer) {
+                // The drawing is timed apart from the swap, which waits for the display
+                {
+                    PROFILE_SCOPE("render");
 
-                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);             
-                glMatrixMode(GL_PROJECTION);
-                glLoadIdentity();
-                glOrtho(0.f, WIDTH, 0.f, HEIGHT, 0.f, 1.f);
-                glMatrixMode(GL_MODELVIEW);
-                glLoadIdentity();
+                    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);             
+                    glMatrixMode(GL_MODELVIEW);
+                    glLoadIdentity();
 
-                // Draw Sky
-                glColor3f(1.0f, 1.0f, 1.0f);
-                texture_utils::draw_texture(0, 0, sky_texture_info, WIDTH, HEIGHT);
+                    // Draw Sky, fixed behind the world
+                    set_projection(0.f, WIDTH, 0.f, HEIGHT);
+                    glColor3f(1.0f, 1.0f, 1.0f);
+                    texture_utils::draw_texture(0, 0, sky_texture_info, WIDTH, HEIGHT);
+
+                    // The world is drawn in world coordinates through the camera
+                    float left = camera.left();
+                    float right = camera.right();
+                    float bottom = camera.bottom();
+                    float top = camera.top();
+                    set_projection(left, right, bottom, top);
+
+                    // Draw a grid where the user can place particles if the simulation is not running
+                    if (!running){
+                        glEnable(GL_BLEND);
+                        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+                        glBegin(GL_LINES);
+                        glColor4f(0.33f, 0.2f, 0.33f, 0.25f);
+
+                        // vertical lines, only those in view, spaced like the grid structures snap to
+                        constexpr float grid = EarthquakeSystem<float>::GRID_SIZE;
+                        float world_width = camera.world_width();
+                        float world_height = camera.world_height();
+                        for (float i = std::max(0.f, std::ceil(left / grid) * grid); i < std::min(world_width, right); i += grid) {
+                            glVertex2f(i, 0);
+                            glVertex2f(i, world_height);
+                        }
+
+                        // horizontal lines
+                        float first_row = ground_height + std::max(0.f, std::ceil((bottom - ground_height) / grid) * grid);
+                        for (float i = first_row; i < std::min(world_height, top); i += grid) {
+                            glVertex2f(0, i);
+                            glVertex2f(world_width, i);
+                        }
+                        glEnd();
+
+                        glBlendFunc(GL_NONE, GL_NONE);
+                        glDisable(GL_BLEND);
+                    }
 
-                // Draw a grid where the user can place particles if the simulation is not running
-                if (!running){
+                    // Draw ground
+                    glColor3f(1.0f, 1.0f, 1.0f);
+                    texture_utils::draw_texture(0, 0, ground_texture_info, camera.world_width() + ground_dx + 100, ground_height);
+
+                    // Particles and joints are drawn from the same vertex buffer, which holds the
+                    // positions of the particles in view followed by those of the ends of the joints
+                    // in view that are not, and is refilled every frame. Joints index into it. Points
+                    // are culled with a margin of their radius.
+                    float margin = 4 / camera.zoom();
+                    std::size_t drawn_particles = upload_visible(system, interpolation, left - margin, bottom - margin, right + margin, top + margin);
+                    glBindBuffer(GL_ARRAY_BUFFER, particle_buffer);
+                    glEnableClientState(GL_VERTEX_ARRAY);
+                    glVertexPointer(2, GL_FLOAT, 0, nullptr);
+
+                    // Draw particles
                     glEnable(GL_BLEND);
                     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                    glEnable(GL_POINT_SMOOTH);
+                    glPointSize(8.0);
+
+                    glColor3f(1.0f, 0.0f, 0.0f);
+                    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(drawn_particles));
+                    if (selected_particle && selected_particle->valid()) {
+                        std::uint32_t selected = selected_particle->handle().index;
+                        if (selected < slots.size() && slot_frames[selected] == frame && slots[selected] < drawn_particles) {
+                            glColor3f(0.0f, 1.0f, 0.0f);
+                            glDrawArrays(GL_POINTS, slots[selected], 1);
+                        }
+                    }
+                    glDisable(GL_POINT_SMOOTH);
+                    glBlendFunc(GL_NONE, GL_NONE);
+                    glDisable(GL_BLEND);
 
-                    glBegin(GL_LINES);
-                    glColor4f(0.33f, 0.2f, 0.33f, 0.25f);
-
-                    // vertical lines
-                    for (int i = 0; i < WIDTH; i += 20) {
-                        glVertex2f(i, 0);
-                        glVertex2f(i, HEIGHT);
+                    // Draw joints
+                    glColor3f(0.0f, 0.0f, 1.0f);
+                    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, joint_index_buffer);
+                    glDrawElements(GL_LINES, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, nullptr);
+
+                    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+                    glDisableClientState(GL_VERTEX_ARRAY);
+                    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+                    // The menu is drawn over the world in window coordinates
+                    set_projection(0.f, WIDTH, 0.f, HEIGHT);
+
+                    // Print current editor mode if the simulation is not running
+                    glColor3f(1.f, 1.0f, 1.0f);
+                    if (!running) {
+                        switch(insertion_mode) {
+                            case insertion_mode_t::PARTICLE:
+                                font_controller.glPrint(10, HEIGHT-30, "Inserting Particles");
+                                break;
+                            case insertion_mode_t::JOINT:
+                                font_controller.glPrint(10, HEIGHT-30, "Inserting Joints");
+                                break;
+                        }
+                        font_controller.glPrint(WIDTH-180, HEIGHT-40, "Paused");
                     }
 
-                    // horizontal lines
-                    for (float i = ground_height; i < HEIGHT; i += 20) {
-                        glVertex2f(0, i);
-                        glVertex2f(WIDTH, i);
+                    // Draw Menu (Start, stop, timer) in the top right of the window
+                    if (running) {
+                        glColor3f(1.0f, 1.0f, 1.0f);
+                        font_controller.glPrint(WIDTH-200, HEIGHT-40, timer.c_str());
                     }
+
+                    // Set color to green
+                    glColor3f(0.0f, 1.0f, 0.0f);
+                    // Draw start button
+                    glBegin(GL_TRIANGLES);
+                        glVertex2f(start_bbox.xmax(), (start_bbox.ymax() + start_bbox.ymin())/2);
+                        glVertex2f(start_bbox.xmin(), start_bbox.ymin());
+                        glVertex2f(start_bbox.xmin(), start_bbox.ymax());
                     glEnd();
 
-                    glBlendFunc(GL_NONE, GL_NONE);
-                    glDisable(GL_BLEND);
-                }
+                    // Draw stop button
+                    glColor3f(1.0f, 0.0f, 0.0f);
+                    glBegin(GL_QUADS);
+                        glVertex2f(stop_bbox.xmax(), stop_bbox.ymin());
+                        glVertex2f(stop_bbox.xmax(), stop_bbox.ymax());
+                        glVertex2f(stop_bbox.xmin(), stop_bbox.ymax());
+                        glVertex2f(stop_bbox.xmin(), stop_bbox.ymin());
+                    glEnd();
 
-                // Print current editor mode if the simulation is not running
-                glColor3f(1.f, 1.0f, 1.0f);
-                if (!running) {
-                    switch(insertion_mode) {
-                        case insertion_mode_t::PARTICLE:
-                            font_controller.glPrint(10, HEIGHT-30, "Inserting Particles");
-                            break;
-                        case insertion_mode_t::JOINT:
-                            font_controller.glPrint(10, HEIGHT-30, "Inserting Joints");
-                            break;
-                    }
-                    font_controller.glPrint(WIDTH-180, HEIGHT-40, "Paused");
-                }
+                    // Draw magnitude buttons
+                    // Horizontal adjustment
+                    glColor3f(1.f, 1.0f, 1.0f);
+                    font_controller.glPrint(WIDTH-280, HEIGHT-80, (std::string("Horiz. Shake: ") + std::to_string(horizontal_magnitude)).c_str());
 
-                // Draw Menu (Start, stop, timer) in the top right of the window
-                if (running) {
-                    glColor3f(1.0f, 1.0f, 1.0f);
-                    font_controller.glPrint(WIDTH-200, HEIGHT-40, timer.c_str());
-                }
-                
-                // Set color to green
-                glColor3f(0.0f, 1.0f, 0.0f);
-                // Draw start button
-                glBegin(GL_TRIANGLES);
-                    glVertex2f(start_bbox.xmax(), (start_bbox.ymax() + start_bbox.ymin())/2);
-                    glVertex2f(start_bbox.xmin(), start_bbox.ymin());
-                    glVertex2f(start_bbox.xmin(), start_bbox.ymax());
-                glEnd();
-
-                // Draw stop button
-                glColor3f(1.0f, 0.0f, 0.0f);
-                glBegin(GL_QUADS);
-                    glVertex2f(stop_bbox.xmax(), stop_bbox.ymin());
-                    glVertex2f(stop_bbox.xmax(), stop_bbox.ymax());
-                    glVertex2f(stop_bbox.xmin(), stop_bbox.ymax());
-                    glVertex2f(stop_bbox.xmin(), stop_bbox.ymin());
-                glEnd();
-
-                // Draw magnitude buttons
-                // Horizontal adjustment
-                glColor3f(1.f, 1.0f, 1.0f);
-                font_controller.glPrint(WIDTH-280, HEIGHT-80, (std::string("Horiz. Shake: ") + std::to_string(horizontal_magnitude)).c_str());
-
-                // Set color to blue
-                glColor3f(0.0f, 0.0f, 1.0f);
-                glBegin(GL_TRIANGLES);
-                    glVertex2f(horizontal_mag_up_bbox.xmax(), horizontal_mag_up_bbox.ymin());
-                    glVertex2f(horizontal_mag_up_bbox.xmin(), horizontal_mag_up_bbox.ymin());
-                    glVertex2f((horizontal_mag_up_bbox.xmax() + horizontal_mag_up_bbox.xmin()) / 2, horizontal_mag_up_bbox.ymax());
-                glEnd();
-                glBegin(GL_TRIANGLES);
-                    glVertex2f(horizontal_mag_down_bbox.xmax(), horizontal_mag_down_bbox.ymax());
-                    glVertex2f(horizontal_mag_down_bbox.xmin(), horizontal_mag_down_bbox.ymax());
-                    glVertex2f((horizontal_mag_down_bbox.xmax() + horizontal_mag_down_bbox.xmin()) / 2, horizontal_mag_down_bbox.ymin());
-                glEnd();
-
-                // Vertical adjustment
-                glColor3f(1.f, 1.0f, 1.0f);
-                font_controller.glPrint(WIDTH-267, HEIGHT-120, (std::string("Vert. Shake: ") + std::to_string(vertical_magnitude)).c_str());
-
-                // Set color to blue
-                glColor3f(0.0f, 0.0f, 1.0f);
-                glBegin(GL_TRIANGLES);
-                    glVertex2f(vertical_mag_up_bbox.xmax(), vertical_mag_up_bbox.ymin());
-                    glVertex2f(vertical_mag_up_bbox.xmin(), vertical_mag_up_bbox.ymin());
-                    glVertex2f((vertical_mag_up_bbox.xmax() + vertical_mag_up_bbox.xmin()) / 2, vertical_mag_up_bbox.ymax());
-                glEnd();
-                glBegin(GL_TRIANGLES);
-                    glVertex2f(vertical_mag_down_bbox.xmax(), vertical_mag_down_bbox.ymax());
-                    glVertex2f(vertical_mag_down_bbox.xmin(), vertical_mag_down_bbox.ymax());
-                    glVertex2f((vertical_mag_down_bbox.xmax() + vertical_mag_down_bbox.xmin()) / 2, vertical_mag_down_bbox.ymin());
-                glEnd();
-
-                // Draw ground
-                glColor3f(1.0f, 1.0f, 1.0f);
-                texture_utils::draw_texture(0, 0, ground_texture_info, WIDTH + ground_dx + 100, ground_height);
-
-                // Draw particles
-                glEnable(GL_BLEND);
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-                glEnable(GL_POINT_SMOOTH);
-                glPointSize(8.0);
-
-                glBegin(GL_POINTS);
-                for (auto& particle : particles) {
-                    if(selected_particle && particle == *selected_particle) {
-                        glColor3f(0.0f, 1.0f, 0.0f);
-                    }
-                    else {
-                        glColor3f(1.0f, 0.0f, 0.0f);
-                    }
-                    glVertex2f(particle.x(), particle.y());
-                }
-                glEnd();
-                glDisable(GL_POINT_SMOOTH);
-                glBlendFunc(GL_NONE, GL_NONE);
-                glDisable(GL_BLEND);
-
-                // Draw joints
-                glBegin(GL_LINES);
-                for (auto& joint : joints) {
+                    // Set color to blue
+                    glColor3f(0.0f, 0.0f, 1.0f);
+                    glBegin(GL_TRIANGLES);
+                        glVertex2f(horizontal_mag_up_bbox.xmax(), horizontal_mag_up_bbox.ymin());
+                        glVertex2f(horizontal_mag_up_bbox.xmin(), horizontal_mag_up_bbox.ymin());
+                        glVertex2f((horizontal_mag_up_bbox.xmax() + horizontal_mag_up_bbox.xmin()) / 2, horizontal_mag_up_bbox.ymax());
+                    glEnd();
+                    glBegin(GL_TRIANGLES);
+                        glVertex2f(horizontal_mag_down_bbox.xmax(), horizontal_mag_down_bbox.ymax());
+                        glVertex2f(horizontal_mag_down_bbox.xmin(), horizontal_mag_down_bbox.ymax());
+                        glVertex2f((horizontal_mag_down_bbox.xmax() + horizontal_mag_down_bbox.xmin()) / 2, horizontal_mag_down_bbox.ymin());
+                    glEnd();
+
+                    // Vertical adjustment
+                    glColor3f(1.f, 1.0f, 1.0f);
+                    font_controller.glPrint(WIDTH-267, HEIGHT-120, (std::string("Vert. Shake: ") + std::to_string(vertical_magnitude)).c_str());
+
+                    // Set color to blue
                     glColor3f(0.0f, 0.0f, 1.0f);
-                    glVertex2f(joint.x1(), joint.y1());
-                    glVertex2f(joint.x2(), joint.y2());
+                    glBegin(GL_TRIANGLES);
+                        glVertex2f(vertical_mag_up_bbox.xmax(), vertical_mag_up_bbox.ymin());
+                        glVertex2f(vertical_mag_up_bbox.xmin(), vertical_mag_up_bbox.ymin());
+                        glVertex2f((vertical_mag_up_bbox.xmax() + vertical_mag_up_bbox.xmin()) / 2, vertical_mag_up_bbox.ymax());
+                    glEnd();
+                    glBegin(GL_TRIANGLES);
+                        glVertex2f(vertical_mag_down_bbox.xmax(), vertical_mag_down_bbox.ymax());
+                        glVertex2f(vertical_mag_down_bbox.xmin(), vertical_mag_down_bbox.ymax());
+                        glVertex2f((vertical_mag_down_bbox.xmax() + vertical_mag_down_bbox.xmin()) / 2, vertical_mag_down_bbox.ymin());
+                    glEnd();
+
+                    // Draw the time spent in each phase during the last frame
+                    if (show_profile) {
+                        glColor3f(1.0f, 1.0f, 0.0f);
+                        int y = HEIGHT - 70;
+                        for (const profiling::PhaseTotal& phase : profiling::Profiler::instance().last_frame()) {
+                            char line[64];
+                            snprintf(line, sizeof(line), "%s: %.2f ms", phase.name, phase.milliseconds);
+                            font_controller.glPrint(10, y, line);
+                            y -= 25;
+                        }
+                    }
                 }
-                glEnd();
 
+                PROFILE_SCOPE("swap_buffers");
                 glfwSwapBuffers(window);
             }
 
@@ -240,6 +295,10 @@ namespace game {
                 }
 
                 glfwMakeContextCurrent(window);
+                if (glewInit() != GLEW_OK)
+                    throw std::runtime_error("Failed to initialize GLEW");
+                glGenBuffers(1, &particle_buffer);
+                glGenBuffers(1, &joint_index_buffer);
                 glViewport(0, 0, WIDTH, HEIGHT);
                 glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
                 glDisable(GL_DEPTH_TEST);
@@ -251,9 +310,93 @@ namespace game {
             }
 
         private:
-            static FontController font_controller;
+            // Sets an orthographic projection showing the given rectangle.
+            void set_projection(float left, float right, float bottom, float top) {
+                glMatrixMode(GL_PROJECTION);
+                glLoadIdentity();
+                glOrtho(left, right, bottom, top, 0.f, 1.f);
+                glMatrixMode(GL_MODELVIEW);
+            }
+
+            // Returns the interpolated position of the particle at index i.
+            static std::pair<float, float> interpolated(std::span<const float> xs, std::span<const float> ys,
+                                                        const interpolation_t& interpolation, std::size_t i) {
+                if (i >= interpolation.previous_x.size()) {
+                    return {xs[i], ys[i]};
+                }
+                return {interpolation.previous_x[i] + interpolation.alpha * (xs[i] - interpolation.previous_x[i]),
+                        interpolation.previous_y[i] + interpolation.alpha * (ys[i] - interpolation.previous_y[i])};
+            }
+
+            // Fills the vertex buffer with the interpolated positions of the particles in the given
+            // rectangle and the index buffer with the joints overlapping it, looked up with the
+            // grid of the system so the cost depends on what is in view rather than on the size of
+            // the world. Ends of those joints outside the rectangle are appended to the vertex
+            // buffer after the particles in view. Returns the number of particles in view. Both
+            // buffers are orphaned before being refilled so the driver does not have to wait for
+            // the previous frame to finish drawing from them.
+            std::size_t upload_visible(physics::ParticleSystem<float>& system, const interpolation_t& interpolation,
+                                       float xmin, float ymin, float xmax, float ymax) {
+                std::span<const float> xs = system.xs();
+                std::span<const float> ys = system.ys();
+                // slot of every particle in the vertex buffer, valid if stamped with this frame
+                ++frame;
+                if (slots.size() < xs.size()) {
+                    slots.resize(xs.size());
+                    slot_frames.resize(xs.size(), 0);
+                }
+                vertices.clear();
+                auto add_vertex = [&](std::uint32_t i) {
+                    slot_frames[i] = frame;
+                    slots[i] = static_cast<std::uint32_t>(vertices.size() / 2);
+                    auto [x, y] = interpolated(xs, ys, interpolation, i);
+                    vertices.push_back(x);
+                    vertices.push_back(y);
+                };
+                // particles are culled at their simulated position, which the interpolated one
+                // is at most a step away from
+                system.for_each_particle_in(xmin, ymin, xmax, ymax, add_vertex);
+                std::size_t visible = vertices.size() / 2;
+
+                indices.clear();
+                system.for_each_joint_in(xmin, ymin, xmax, ymax, [&](std::uint32_t j) {
+                    const physics::JointConstraint<float>& joint = system.joint_constraints()[j];
+                    for (std::uint32_t p : {joint.p1, joint.p2}) {
+                        if (slot_frames[p] != frame) {
+                            add_vertex(p);
+                        }
+                        indices.push_back(slots[p]);
+                    }
+                });
+
+                glBindBuffer(GL_ARRAY_BUFFER, particle_buffer);
+                glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), nullptr, GL_STREAM_DRAW);
+                glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(float), vertices.data());
+                glBindBuffer(GL_ARRAY_BUFFER, 0);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, joint_index_buffer);
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(std::uint32_t), nullptr, GL_STREAM_DRAW);
+                glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.size() * sizeof(std::uint32_t), indices.data());
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+                return visible;
+            }
+
+            FontController font_controller;
             texture_utils::texture_info_t ground_texture_info;
             texture_utils::texture_info_t sky_texture_info;
+
+            // Vertex buffer of particle positions and index buffer of joints
+            GLuint particle_buffer = 0;
+            GLuint joint_index_buffer = 0;
+
+            // Staging memory for the buffers, kept between frames
+            std::vector<float> vertices;
+            std::vector<std::uint32_t> indices;
+
+            // Slot of every particle in the vertex buffer, valid for the particles whose entry of
+            // slot_frames is the number of the frame being drawn, so they need no clearing
+            std::vector<std::uint32_t> slots;
+            std::vector<std::uint32_t> slot_frames;
+            std::uint32_t frame = 0;
             
     };
 }
\ No newline at end of file
@@ -0,0 +1,371 @@
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "earthquake_system.hpp"
+#include "event_log.hpp"
+#include "ground_motion.hpp"
+#include "particle_system.hpp"
+#include "simulation_pool.hpp"
+#include "snapshot.hpp"
+#include "structure_builder.hpp"
+
+// Regression tests for the physics. Every test returns whether it passed, the program fails if
+// any of them did not.
+namespace {
+    using System = physics::ParticleSystem<float>;
+
+    struct test_t {
+        const char* name;
+        std::function<bool()> run;
+    };
+
+    // Clearing a system with an island asleep and building a scene with as many joints as were awake
+    // must not relax the new joints with the indices of the old ones.
+    bool clear_resets_awake_joints() {
+        System system(0, 1000, 0, 100000, 0, -1);
+        system.set_sleep_config(physics::SleepConfig<float>{1e-4f, 5});
+        system.set_strain_tracking(true);
+        // a single iteration leaves the strain of the joints before they were corrected
+        system.set_solver_config(physics::SolverConfig<float>{1, 1, 0});
+
+        // joint 0 rests on the ground and falls asleep, joint 1 is still falling
+        physics::Particle<float> grounded1 = system.create_particle(10, 0, true);
+        physics::Particle<float> grounded2 = system.create_particle(30, 0, false);
+        physics::Particle<float> falling1 = system.create_particle(100, 90000, false);
+        physics::Particle<float> falling2 = system.create_particle(120, 90000, false);
+        system.create_joint(grounded1, grounded2);
+        system.create_joint(falling1, falling2);
+        for (int i = 0; i < 20; ++i) {
+            system.update(1);
+        }
+        if (system.asleep_count() != 2 || system.asleep(2)) {
+            std::cerr << "  expected only the grounded island to be asleep" << std::endl;
+            return false;
+        }
+
+        // a single joint hanging from a fixed particle, stretched by gravity
+        system.clear();
+        physics::Particle<float> anchor = system.create_particle(10, 50, true);
+        physics::Particle<float> hanging = system.create_particle(10, 30, false);
+        system.create_joint(anchor, hanging);
+        system.update(1);
+        if (system.strains().size() != 1 || system.strains()[0] <= 0) {
+            std::cerr << "  expected the strain of the hanging joint to be recorded" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // A particle exactly radius away is not near, of two equally near the first created is returned.
+    bool particle_near_is_strict() {
+        System system(0, 1000, 0, 1000, 0, -1);
+        system.create_particle(60, 40, false);
+        system.create_particle(40, 40, false);
+        if (system.particle_near(50, 40, 10)) {
+            std::cerr << "  expected no particle strictly within the radius" << std::endl;
+            return false;
+        }
+        std::optional<physics::Particle<float>> near = system.particle_near(50, 40, 11);
+        if (!near || near->x() != 60) {
+            std::cerr << "  expected the first of two equally near particles" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Builds a small frame in system, driven by the accelerogram at path, and returns its particle
+    // positions after steps steps.
+    std::vector<float> shake_frame(game::EarthquakeSystem<float>& system, const std::string& path, int steps) {
+        for (float x = 100; x < 160; x += 20) {
+            system.create_joint(x, system.ground_height(), x, system.ground_height() + 20);
+            system.create_joint(x, system.ground_height() + 20, x + 20, system.ground_height() + 20);
+        }
+        if (!system.ground_motion_source()) {
+            system.set_ground_motion(std::make_unique<game::AccelerogramMotion>(game::open_accelerogram(path), 10));
+        }
+        for (int i = 0; i < steps; ++i) {
+            system.update();
+        }
+        std::vector<float> positions(system.particle_system().xs().begin(), system.particle_system().xs().end());
+        positions.insert(positions.end(), system.particle_system().ys().begin(), system.particle_system().ys().end());
+        return positions;
+    }
+
+    // A reset system runs a recorded earthquake from its start again, like a new system.
+    bool reset_rewinds_ground_motion() {
+        std::string path = (std::filesystem::temp_directory_path() / "physics_test_accelerogram.csv").string();
+        {
+            std::ofstream file(path);
+            file << "time,horizontal,vertical\n";
+            for (int i = 0; i < 100; ++i) {
+                file << i * 0.05 << "," << std::sin(i * 0.3) << "," << 0.5 * std::cos(i * 0.2) << "\n";
+            }
+        }
+
+        game::EarthquakeSystem<float> fresh(640, 480, 40);
+        std::vector<float> expected = shake_frame(fresh, path, 30);
+        game::EarthquakeSystem<float> reused(640, 480, 40);
+        shake_frame(reused, path, 45);
+        reused.reset();
+        std::vector<float> actual = shake_frame(reused, path, 30);
+        std::filesystem::remove(path);
+
+        if (actual != expected) {
+            std::cerr << "  expected the second run to match a new system" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // A step of no time is rejected instead of making the speed of the ground, and every adaptive
+    // timestep after it, NaN.
+    bool update_rejects_empty_timestep() {
+        game::EarthquakeSystem<float> system(640, 480, 40);
+        system.update();
+        try {
+            system.update(0);
+            std::cerr << "  expected a timestep of 0 to be rejected" << std::endl;
+            return false;
+        } catch (std::invalid_argument&) {}
+        double dt = system.next_timestep();
+        if (!(dt > 0) || system.timestep_config().max_distance != game::EarthquakeSystem<float>::COLLISION_RADIUS) {
+            std::cerr << "  expected a positive timestep limited by the collision radius" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // A ground motion that fails after a few steps, like a truncated record.
+    class FailingMotion : public game::GroundMotion {
+    public:
+        std::pair<double, double> advance(double) override {
+            if (++steps_ > 3) {
+                throw std::runtime_error("truncated");
+            }
+            return {0, 0};
+        }
+
+        void rewind() override {
+            steps_ = 0;
+        }
+
+    private:
+        int steps_ = 0;
+    };
+
+    // An exception thrown while updating a system on a worker thread reaches the caller, and the
+    // pool can still be used afterwards.
+    bool pool_rethrows_update_errors() {
+        game::SimulationPool<float> simulations(2);
+        for (int i = 0; i < 4; ++i) {
+            simulations.add(640, 480, 40);
+        }
+        simulations[3].set_ground_motion(std::make_unique<FailingMotion>());
+        try {
+            simulations.update(game::EarthquakeSystem<float>::TIMESTEP, 10);
+            std::cerr << "  expected the error of the last system to be rethrown" << std::endl;
+            return false;
+        } catch (std::runtime_error& e) {
+            if (std::string(e.what()) != "truncated") {
+                throw;
+            }
+        }
+        simulations[3].set_ground_motion(nullptr);
+        simulations.update(game::EarthquakeSystem<float>::TIMESTEP);
+        return true;
+    }
+
+    // A body resting asleep on the ground falls with it when the ground drops.
+    bool dropping_ground_wakes_resting_bodies() {
+        System system(0, 1000, 0, 1000, 0, -1);
+        system.set_sleep_config(physics::SleepConfig<float>{1e-4f, 5});
+        physics::Particle<float> left = system.create_particle(10, 0, false);
+        physics::Particle<float> right = system.create_particle(30, 0, false);
+        system.create_joint(left, right);
+        for (int i = 0; i < 20; ++i) {
+            system.update(1);
+        }
+        if (system.asleep_count() != 2) {
+            std::cerr << "  expected the resting body to fall asleep" << std::endl;
+            return false;
+        }
+
+        for (int i = 0; i < 5; ++i) {
+            system.update(1, 0, -2);
+        }
+        if (system.asleep_count() != 0 || system.y(0) > -5 || system.y(1) > -5) {
+            std::cerr << "  expected the resting body to fall with the ground" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // An event log carries the settings of the physics it was recorded with, and replaying it applies
+    // them over whatever the replaying system was configured with.
+    bool event_log_keeps_settings() {
+        std::string path = (std::filesystem::temp_directory_path() / "physics_test_events.log").string();
+        game::EarthquakeSystem<float> recorded(640, 480, 40);
+        recorded.particle_system().set_solver_config(physics::SolverConfig<float>{2, 7, 0.01f});
+        recorded.particle_system().set_sleep_config(physics::SleepConfig<float>{0.5f, 12});
+        recorded.particle_system().set_collision_config(physics::CollisionConfig<float>{3, false});
+        recorded.particle_system().set_solver_threads(2);
+        {
+            game::EventRecorder recorder(path, game::event_log_header(640, 480, 40, 1, 1,
+                game::EarthquakeSystem<float>::TIMESTEP, recorded.particle_system()));
+        }
+
+        game::EarthquakeSystem<float> replayed(640, 480, 40);
+        game::EventReader reader(path);
+        game::apply_event_log_settings(reader.header(), replayed.particle_system());
+        std::filesystem::remove(path);
+
+        const physics::ParticleSystem<float>& system = replayed.particle_system();
+        if (system.solver_config().min_iterations != 2 || system.solver_config().max_iterations != 7
+                || system.solver_config().tolerance != 0.01f || system.sleep_config().threshold != 0.5f
+                || system.sleep_config().steps != 12 || system.collision_config().radius != 3
+                || system.collision_config().joints || system.solver_threads() != 2) {
+            std::cerr << "  expected the replayed system to run with the recorded settings" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Returns the positions and sleep state of the particles of system.
+    std::vector<float> state_of(game::EarthquakeSystem<float>& system) {
+        const physics::ParticleSystem<float>& particles = system.particle_system();
+        std::vector<float> state(particles.xs().begin(), particles.xs().end());
+        state.insert(state.end(), particles.ys().begin(), particles.ys().end());
+        state.insert(state.end(), particles.prev_xs().begin(), particles.prev_xs().end());
+        state.insert(state.end(), particles.prev_ys().begin(), particles.prev_ys().end());
+        for (std::size_t i = 0; i < particles.particle_count(); ++i) {
+            state.push_back(particles.asleep(i));
+            state.push_back(float(particles.quiet_steps(i)));
+        }
+        return state;
+    }
+
+    // A run saved and loaded into a new system part way through continues exactly like one never
+    // interrupted, with an adaptive timestep and structures falling asleep.
+    bool snapshot_resumes_exactly() {
+        std::string path = (std::filesystem::temp_directory_path() / "physics_test.snapshot").string();
+        auto build = [](game::EarthquakeSystem<float>& system) {
+            system.particle_system().set_sleep_config(physics::SleepConfig<float>{0.05f, 10});
+            // a frame shaken by the ground and a bar lying on the ground, away from it, that falls asleep
+            for (float x = 100; x < 160; x += 20) {
+                system.create_joint(x, 40, x, 60);
+                system.create_joint(x, 60, x + 20, 60);
+            }
+            system.create_joint(400, 200, 420, 200);
+        };
+        auto advance = [](game::EarthquakeSystem<float>& system, int frames) {
+            for (int i = 0; i < frames; ++i) {
+                system.advance(game::EarthquakeSystem<float>::TIMESTEP * 2);
+            }
+        };
+
+        game::EarthquakeSystem<float> uninterrupted(640, 480, 40, 3, 0);
+        build(uninterrupted);
+        advance(uninterrupted, 40);
+        save_snapshot(uninterrupted, path);
+        advance(uninterrupted, 40);
+
+        game::EarthquakeSystem<float> resumed(640, 480, 40, 3, 0);
+        resumed.particle_system().set_sleep_config(physics::SleepConfig<float>{0.05f, 10});
+        // a step of another length before loading must not leak into the resumed run
+        resumed.update(0.37);
+        load_snapshot(resumed, path);
+        advance(resumed, 40);
+        std::filesystem::remove(path);
+
+        if (state_of(resumed) != state_of(uninterrupted) || resumed.run_time() != uninterrupted.run_time()) {
+            std::cerr << "  expected the resumed run to match the uninterrupted one" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // The errors the tolerance is checked against, and so the whole run, are the same for any
+    // number of solver threads above one.
+    bool relaxation_independent_of_thread_count() {
+        std::vector<float> expected;
+        for (unsigned int threads = 2; threads <= 5; ++threads) {
+            game::EarthquakeSystem<float> system(2000, 2000, 40, 5, 3);
+            system.particle_system().set_solver_threads(threads);
+            system.particle_system().set_solver_config(physics::SolverConfig<float>{1, 10, 0.01f});
+            game::StructureBuilder<float> builder;
+            game::add_grid(builder, 100.f, 40.f, 40u, 40u, 20.f);
+            builder.build(system.particle_system());
+
+            std::vector<float> run;
+            for (int i = 0; i < 20; ++i) {
+                system.update();
+                const physics::SolverStats<float>& stats = system.particle_system().solver_stats();
+                run.push_back(float(stats.iterations));
+                run.push_back(stats.max_error);
+                run.push_back(stats.rms_error);
+            }
+            run.insert(run.end(), system.particle_system().xs().begin(), system.particle_system().xs().end());
+            run.insert(run.end(), system.particle_system().ys().begin(), system.particle_system().ys().end());
+            if (expected.empty()) {
+                expected = run;
+            } else if (run != expected) {
+                std::cerr << "  expected the run with " << threads << " threads to match the one with 2" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Particles at exactly the same position are pushed apart, the first created to the left, and
+    // so is a particle exactly on a joint.
+    bool coincident_contacts_separate() {
+        // without gravity so that nothing moves the particles but the contacts
+        System system(0, 1000, 0, 1000, 0, 0);
+        system.set_collision_config(physics::CollisionConfig<float>{4, true});
+        system.create_particle(100, 500, false);
+        system.create_particle(100, 500, false);
+        physics::Particle<float> left = system.create_particle(300, 500, true);
+        physics::Particle<float> right = system.create_particle(340, 500, true);
+        system.create_joint(left, right);
+        system.create_particle(320, 500, false);
+        system.update(1);
+        if (!(system.x(1) - system.x(0) >= 7.9f) || !(system.y(4) - system.y(2) >= 3.9f)) {
+            std::cerr << "  expected coincident contacts to be separated" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    const std::vector<test_t> tests = {
+        {"clear_resets_awake_joints", clear_resets_awake_joints},
+        {"particle_near_is_strict", particle_near_is_strict},
+        {"reset_rewinds_ground_motion", reset_rewinds_ground_motion},
+        {"update_rejects_empty_timestep", update_rejects_empty_timestep},
+        {"pool_rethrows_update_errors", pool_rethrows_update_errors},
+        {"dropping_ground_wakes_resting_bodies", dropping_ground_wakes_resting_bodies},
+        {"event_log_keeps_settings", event_log_keeps_settings},
+        {"snapshot_resumes_exactly", snapshot_resumes_exactly},
+        {"relaxation_independent_of_thread_count", relaxation_independent_of_thread_count},
+        {"coincident_contacts_separate", coincident_contacts_separate},
+    };
+}
+
+int main() {
+    int failures = 0;
+    for (const test_t& test : tests) {
+        bool passed = test.run();
+        std::cout << (passed ? "pass " : "FAIL ") << test.name << std::endl;
+        failures += passed ? 0 : 1;
+    }
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}